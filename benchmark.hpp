@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+
+#include "context.hpp"
+
+// collects per frame timings after a warm up and summarizes them, json output
+// is meant to be diffed against earlier runs by whatever runs the nightlies
+struct Benchmark
+{
+    struct Summary
+    {
+        float min {0.f};
+        float mean {0.f};
+        float p50 {0.f};
+        float p95 {0.f};
+        float p99 {0.f};
+        float max {0.f};
+    };
+
+    struct Series
+    {
+        const char* name;
+        Array<float> samples;
+    };
+
+    u32 warmup {60};
+    u32 frames {600};
+    u32 seen {0};
+
+    Series series[5] {{"acquire"}, {"record"}, {"submit"}, {"present"}, {"frame"}};
+
+    void init(const u32 w, const u32 n)
+    {
+        warmup = w;
+        frames = n;
+        for(auto& s : series)
+        {
+            s.samples.clear();
+            s.samples.reserve(frames);
+        }
+    }
+
+    bool done() const
+    {
+        return seen >= warmup + frames;
+    }
+
+    // frame is the full interval between two frame starts
+    void add(const FrameTimings& t, const float frame)
+    {
+        if(seen++ < warmup){
+            return;
+        }
+        series[0].samples.push_back(t.acquire);
+        series[1].samples.push_back(t.record);
+        series[2].samples.push_back(t.submit);
+        series[3].samples.push_back(t.present);
+        series[4].samples.push_back(frame);
+    }
+
+    static Summary summarize(Array<float> v)
+    {
+        Summary s;
+        if(v.empty()){
+            return s;
+        }
+
+        std::sort(v.begin(), v.end());
+
+        // nearest rank
+        auto percentile {[&](const float p)
+        {
+            auto i {(size_t)ceilf(p * v.size())};
+            i = i == 0 ? 0 : i - 1;
+            return v[std::min(i, v.size() - 1)];
+        }};
+
+        double sum {0.0};
+        for(auto x : v){
+            sum += x;
+        }
+
+        s.min = v.front();
+        s.max = v.back();
+        s.mean = sum / v.size();
+        s.p50 = percentile(0.50f);
+        s.p95 = percentile(0.95f);
+        s.p99 = percentile(0.99f);
+        return s;
+    }
+
+    void print(FILE* f = stdout)
+    {
+        fprintf(f, "%-8s %9s %9s %9s %9s %9s %9s   (ms, %u frames after %u warm up)\n",
+                "", "min", "mean", "p50", "p95", "p99", "max", frames, warmup);
+        for(auto& s : series)
+        {
+            const auto r {summarize(s.samples)};
+            fprintf(f, "%-8s %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", s.name, r.min, r.mean, r.p50, r.p95, r.p99, r.max);
+        }
+    }
+
+    // device names and replay paths can hold quotes, backslashes and control characters
+    static String escape(const char* s)
+    {
+        String out;
+        for(; *s; s++)
+        {
+            const auto c {(unsigned char)*s};
+            if(c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if(c < 0x20)
+            {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", c);
+                out += code;
+            }
+            else{
+                out += c;
+            }
+        }
+        return out;
+    }
+
+    String json(Context& context, const char* scene)
+    {
+        String out;
+        char line[512];
+
+        // a path can be longer than any line buffer
+        out += "{\n  \"scene\": \"" + escape(scene) + "\",\n  \"device\": \"" + escape(context.gpu->properties.deviceName) + "\",\n";
+        snprintf(line, sizeof(line),
+                 "  \"headless\": %s,\n  \"width\": %d,\n  \"height\": %d,\n"
+                 "  \"warmup\": %u,\n  \"frames\": %u,\n  \"unit\": \"ms\",\n  \"series\": {\n",
+                 context.headless ? "true" : "false", context.width, context.height, warmup, frames);
+        out += line;
+
+        for(u32 i = 0; i < array_size(series); i++)
+        {
+            const auto r {summarize(series[i].samples)};
+            snprintf(line, sizeof(line),
+                     "    \"%s\": {\"min\": %.4f, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+                     series[i].name, r.min, r.mean, r.p50, r.p95, r.p99, r.max, i + 1 < array_size(series) ? "," : "");
+            out += line;
+        }
+
+        out += "  },\n  \"memory\": ";
+        out += context.memory.json();
+        out += "\n}\n";
+        return out;
+    }
+};
@@ -4,11 +4,16 @@
 #include <SDL_vulkan.h>
 #include <vulkan/vulkan.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <mutex>
+
+#include "descriptors.hpp"
+#include "memory.hpp"
 #include "types.hpp"
-
-#define VKT(x) VK_STRUCTURE_TYPE_##x
-
-#define check_vk(x) if(x != VK_SUCCESS) assert(false);
+#include "utilities.hpp"
 
 struct GPU
 {
@@ -22,9 +27,17 @@ struct GPU
     VkPhysicalDeviceProperties properties;
     Array<VkSurfaceFormatKHR> surface_formats;
     Array<VkQueueFamilyProperties> queue_families;
+    VkPhysicalDeviceMemoryProperties memory_properties;
 
     Array<VkImage> swapchain_images;
     Array<VkImageView> swapchain_image_views;
+
+    bool draw_indirect_count {false};
+    bool draw_indirect_first_instance {false}; // cull.comp passes the object index as firstInstance
+    bool pipeline_statistics {false};
+    bool memory_budget {false};
+
+    Array<String> extensions;
 };
 
 struct Synchronization
@@ -34,12 +47,36 @@ struct Synchronization
     VkFence fence;
 };
 
+// cpu side cost of a frame in milliseconds
+struct FrameTimings
+{
+    float acquire {0.f}; // fence wait plus vkAcquireNextImageKHR
+    float record {0.f};
+    float submit {0.f};
+    float present {0.f};
+};
+
 struct Pipeline
 {
     VkPipelineLayout layout;
     VkPipeline pipeline;
 };
 
+struct Image
+{
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView view;
+};
+
+struct Buffer
+{
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    void* data {nullptr}; // only mapped for host visible memory
+};
+
 
 struct Context
 {
@@ -55,10 +92,47 @@ struct Context
     VkViewport viewport;
     VkRect2D scissor;
 
+    // the part of the scene, in window pixels, that norm maps onto the render target
+    Rect view;
+
     VkExtent2D extent;
 
     VkRenderPass render_pass;
 
+    // set before init
+    bool depth_enabled {false};
+    VkPresentModeKHR present_mode {VK_PRESENT_MODE_FIFO_KHR}; // falls back to fifo when unsupported
+
+    // no window, rendering goes to a VK_EXT_headless_surface swapchain. set by init when
+    // SDL runs on the offscreen or dummy video driver
+    bool headless {false};
+
+    // set before init when a render graph blits into the swapchain images. only color
+    // attachment use is guaranteed, check swapchain_usage after init
+    bool backbuffer_transfer_dst {false};
+    VkImageUsageFlags swapchain_usage {0};
+
+    // set before init so the swapchain can be copied from, see request_read_back. init
+    // clears it when the surface doesn't support transfer source use
+    bool read_back_enabled {false};
+    bool read_back_requested {false};
+    Buffer read_back_buffer {};
+
+    FrameTimings timings;
+    MemoryTelemetry memory;
+    DescriptorAllocator descriptors;
+    std::chrono::high_resolution_clock::time_point record_start;
+    VkFormat depth_format {VK_FORMAT_D32_SFLOAT};
+    Array<Image> depth_images;
+
+    // stages of the first frame commands that wait on the acquired image
+    VkPipelineStageFlags acquire_wait_stages {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    bool in_render_pass {false};
+
+    VkQueryPool statistics_pool {VK_NULL_HANDLE};
+    bool statistics_pending {false};
+    u64 fragment_invocations {0};
+
     Array<GPU> gpus;
 
     Array<VkFramebuffer> framebuffers;
@@ -78,14 +152,58 @@ struct Context
     VkPipelineMultisampleStateCreateInfo multisample_info      {};
     VkPipelineColorBlendAttachmentState color_blend_attachment {};
     VkPipelineColorBlendStateCreateInfo color_blend_info       {};
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_info   {};
+    VkPipelineDepthStencilStateCreateInfo blend_depth_stencil_info {};
+    VkPipelineDynamicStateCreateInfo dynamic_info              {};
+    VkDynamicState dynamic_states[1] {VK_DYNAMIC_STATE_SCISSOR};
 
     GPU* gpu {nullptr};
 
     float queue_priority {1.f};
 
     Array<Pipeline> pipelines;
+    Array<Pipeline> compute_pipelines;
+
+    // how each pipeline was built, so it can be built again when one of its shaders changes
+    struct PipelineSource
+    {
+        std::function<Pipeline()> build;
+        Array<String> shaders; // what load_shader was called with while building
+    };
+
+    // a rebuilt pipeline waiting for the next begin_frame
+    struct PipelineSwap
+    {
+        u32 id;
+        bool compute;
+        Pipeline pipeline;
+        u32 ticket;
+    };
+
+    struct RetiredPipeline
+    {
+        Pipeline pipeline;
+        u64 frame; // frames presented when it was swapped out
+    };
+
+    Array<PipelineSource> pipeline_sources;
+    Array<PipelineSource> compute_pipeline_sources;
+    std::mutex sources_mutex;
+
+    std::mutex swap_mutex;
+    Array<PipelineSwap> pending_swaps;
+    Array<RetiredPipeline> retired_pipelines;
+    u64 frames_presented {0};
+    u32 swapped_ticket {0};   // newest swap in the frame being recorded
+    u32 presented_ticket {0}; // newest swap that has been submitted
+
+    inline static thread_local Array<String>* shader_recording {nullptr};
+
+    static constexpr const char* generic_fragment_path {"shader.frag.spv"};
     u32 swapchain_image;
 
+    // shared by the builders through use_generic_fragment. after init only the shader
+    // reload thread touches it, it replaces the module and is the only one building then
     VkShaderModule generic_fragment_shader {};
 
     void init(const char* name, const int w, const int h)
@@ -94,16 +212,34 @@ struct Context
 
         width = w;
         height = h;
-        window = SDL_CreateWindow("vulkan test",
-                                  SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                                  width, height,
-                                  SDL_WINDOW_VULKAN);
+        view = {{0.f, 0.f}, {(float)w, (float)h}};
+
+        if(SDL_Init(SDL_INIT_VIDEO) != 0){
+            assert(false);
+        }
+
+        {
+            const String driver {SDL_GetCurrentVideoDriver()};
+            headless = driver == "offscreen" || driver == "dummy";
+        }
+
+        if(!headless)
+        {
+            window = SDL_CreateWindow("vulkan test",
+                                      SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                                      width, height,
+                                      SDL_WINDOW_VULKAN);
+        }
 
         u32 ctr;
         VkResult err;
 
         {
             Array<const char*> extensions;
+            if(headless){
+                extensions = {VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME};
+            }
+            else
             {
                 SDL_Vulkan_GetInstanceExtensions(window, &ctr, nullptr);
                 extensions.resize(ctr);
@@ -159,9 +295,24 @@ struct Context
 
                 err = vkCreateInstance(&info, nullptr, &instance);
                 check_vk(err);
-                auto res {SDL_Vulkan_CreateSurface(window, instance, &surface)};
-                if(res != SDL_TRUE){
-                    assert(false);
+                if(headless)
+                {
+                    auto create {(PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT")};
+                    assert(create);
+
+                    VkHeadlessSurfaceCreateInfoEXT surface_info
+                    {
+                        .sType = VKT(HEADLESS_SURFACE_CREATE_INFO_EXT),
+                    };
+                    err = create(instance, &surface_info, nullptr, &surface);
+                    check_vk(err);
+                }
+                else
+                {
+                    auto res {SDL_Vulkan_CreateSurface(window, instance, &surface)};
+                    if(res != SDL_TRUE){
+                        assert(false);
+                    }
                 }
             }
         }
@@ -200,44 +351,59 @@ struct Context
                     }
                 }
 
-                const char* required_extensions[] {"VK_KHR_portability_subset", VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+                const char* required_extensions[] {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+
+                // enabled when the device has them, portability_subset has to be if present
+                const char* optional_extensions[] {"VK_KHR_portability_subset", VK_EXT_MEMORY_BUDGET_EXTENSION_NAME};
+
+                Array<VkExtensionProperties> extension_properties;
+                {
+                    u32 count {0};
+                    vkEnumerateDeviceExtensionProperties(p, nullptr, &count, nullptr);
+                    extension_properties.resize(count);
+                    err = vkEnumerateDeviceExtensionProperties(p, nullptr, &count, extension_properties.data());
+                    check_vk(err);
+                }
 
-                Array<const char*> device_extensions {required_extensions[0], required_extensions[1]};
+                Array<const char*> device_extensions {required_extensions, required_extensions + array_size(required_extensions)};
 
-                // NOTE this causes an access violation error during second call to vkEnumerateDeviceExtensionProperties
-                // just manually added required extentions for now in the device extensions cause can't check if extension is available for the device!
-                //Array<VkExtensionProperties> extension_properties;
-                //vkEnumerateDeviceExtensionProperties(p, nullptr, &ctr, nullptr);
-                //extension_properties.resize(ctr);
-                //err = vkEnumerateDeviceExtensionProperties(p, nullptr, &ctr, extension_properties.data());
-                //check_vk(err);
+                for(auto& i : extension_properties)
+                {
+                    for(auto j : optional_extensions)
+                    {
+                        if(String{i.extensionName} == j)
+                        {
+                            device_extensions.push_back(j);
+                            break;
+                        }
+                    }
+                }
 
-                //Array<const char*> device_extensions {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+                VkPhysicalDeviceProperties device_properties;
+                vkGetPhysicalDeviceProperties(p, &device_properties);
 
-                //for(auto& i : extension_properties)
-                //{
-                //    for(auto j : required_extensions)
-                //    {
-                //        if(String{i.extensionName} == j)
-                //        {
-                //            device_extensions.push_back(j);
-                //            break;
-                //        }
-                //    }
-                //}
+                // 1.2 features are chained in for drawIndirectCount, only where the device knows the struct
+                VkPhysicalDeviceVulkan12Features features12
+                {
+                    .sType = VKT(PHYSICAL_DEVICE_VULKAN_1_2_FEATURES),
+                };
 
-                VkPhysicalDeviceFeatures features;
+                VkPhysicalDeviceFeatures2 features
+                {
+                    .sType = VKT(PHYSICAL_DEVICE_FEATURES_2),
+                    .pNext = device_properties.apiVersion >= VK_API_VERSION_1_2 ? &features12 : nullptr,
+                };
 
-                vkGetPhysicalDeviceFeatures(p, &features);
+                vkGetPhysicalDeviceFeatures2(p, &features);
 
                 VkDeviceCreateInfo device_info
                 {
                     .sType = VKT(DEVICE_CREATE_INFO),
+                    .pNext = &features,
                     .queueCreateInfoCount = (u32)queue_infos.size(),
                     .pQueueCreateInfos = queue_infos.data(),
                     .enabledExtensionCount = (u32)device_extensions.size(),
                     .ppEnabledExtensionNames = device_extensions.data(),
-                    .pEnabledFeatures = &features
                 };
 
                 VkDevice device;
@@ -249,6 +415,14 @@ struct Context
                 g.gpu = p;
                 g.device = device;
                 g.queue_families = families;
+                g.draw_indirect_count = features12.drawIndirectCount;
+                g.draw_indirect_first_instance = features.features.drawIndirectFirstInstance;
+                g.pipeline_statistics = features.features.pipelineStatisticsQuery;
+                for(auto& e : device_extensions)
+                {
+                    g.extensions.push_back(e);
+                    g.memory_budget |= g.extensions.back() == VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+                }
             }
         }
         assert(!gpus.empty());
@@ -267,6 +441,9 @@ struct Context
         scissor.extent = extent;
 
         vkGetPhysicalDeviceProperties(gpu->gpu, &gpu->properties);
+        vkGetPhysicalDeviceMemoryProperties(gpu->gpu, &gpu->memory_properties);
+        memory.init(gpu->gpu, gpu->memory_properties, gpu->memory_budget);
+        descriptors.init(gpu->device);
 
         vkGetPhysicalDeviceSurfaceFormatsKHR(gpu->gpu, surface, &ctr, nullptr);
         gpu->surface_formats.resize(ctr);
@@ -297,8 +474,38 @@ struct Context
             vkGetDeviceQueue(gpu->device, gpu->queue_index, 0, &gpu->device_queue);
         }
 
+        {
+            Array<VkPresentModeKHR> modes;
+            vkGetPhysicalDeviceSurfacePresentModesKHR(gpu->gpu, surface, &ctr, nullptr);
+            modes.resize(ctr);
+            err = vkGetPhysicalDeviceSurfacePresentModesKHR(gpu->gpu, surface, &ctr, modes.data());
+            check_vk(err);
+
+            auto found {false};
+            for(auto m : modes)
+            {
+                if(m == present_mode){
+                    found = true;
+                }
+            }
+            if(!found){
+                present_mode = VK_PRESENT_MODE_FIFO_KHR;
+            }
+        }
+
         {
             u32 family_indices[] {gpu->queue_index};
+
+            swapchain_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+            if(backbuffer_transfer_dst){
+                swapchain_usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+            }
+            if(read_back_enabled){
+                swapchain_usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            }
+            swapchain_usage &= gpu->capabilities.supportedUsageFlags | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+            read_back_enabled = swapchain_usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
             VkSwapchainCreateInfoKHR info
             {
                 .sType = VKT(SWAPCHAIN_CREATE_INFO_KHR),
@@ -308,13 +515,13 @@ struct Context
                 .imageColorSpace = gpu->format.colorSpace,
                 .imageExtent = extent,
                 .imageArrayLayers = 1,
-                .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                .imageUsage = swapchain_usage,
                 .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
                 .queueFamilyIndexCount = 1,
                 .pQueueFamilyIndices = family_indices,
                 .preTransform = gpu->capabilities.currentTransform,
                 .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-                .presentMode = VK_PRESENT_MODE_FIFO_KHR,
+                .presentMode = present_mode,
                 .clipped = VK_TRUE,
                 .oldSwapchain = VK_NULL_HANDLE,
             };
@@ -327,6 +534,7 @@ struct Context
             err = vkGetSwapchainImagesKHR(gpu->device, gpu->swapchain, &ctr, gpu->swapchain_images.data());
             check_vk(err);
 
+            memory.track_swapchain(ctr, extent);
         }
         {
             VkCommandPoolCreateInfo info
@@ -362,26 +570,60 @@ struct Context
                 .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
             };
 
+            VkAttachmentDescription depth_ad
+            {
+                .format = depth_format,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            };
+
+            VkAttachmentDescription attachments[] {ad, depth_ad};
+
             VkAttachmentReference color_attachment
             {
                 .attachment = 0,
                 .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
             };
 
+            VkAttachmentReference depth_attachment
+            {
+                .attachment = 1,
+                .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            };
+
             VkSubpassDescription sp
             {
                 .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
                 .colorAttachmentCount = 1,
                 .pColorAttachments = &color_attachment,
+                .pDepthStencilAttachment = depth_enabled ? &depth_attachment : nullptr,
+            };
+
+            // the depth image is cleared every frame, wait for the previous frame's tests before that
+            VkSubpassDependency dependency
+            {
+                .srcSubpass = VK_SUBPASS_EXTERNAL,
+                .dstSubpass = 0,
+                .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
             };
 
             VkRenderPassCreateInfo info
             {
                 .sType = VKT(RENDER_PASS_CREATE_INFO),
-                .attachmentCount = 1,
-                .pAttachments = &ad,
+                .attachmentCount = depth_enabled ? 2u : 1u,
+                .pAttachments = attachments,
                 .subpassCount = 1,
                 .pSubpasses = &sp,
+                .dependencyCount = depth_enabled ? 1u : 0u,
+                .pDependencies = &dependency,
             };
 
             err = vkCreateRenderPass(gpu->device, &info, nullptr, &render_pass);
@@ -410,14 +652,22 @@ struct Context
                 check_vk(err);
                 gpu->swapchain_image_views.push_back(image_view);
             }
-            for(auto& i : gpu->swapchain_image_views)
+            if(depth_enabled)
             {
+                for(u32 i = 0; i < gpu->swapchain_image_views.size(); i++){
+                    depth_images.push_back(create_image(extent, depth_format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT));
+                }
+            }
+            for(u32 i = 0; i < gpu->swapchain_image_views.size(); i++)
+            {
+                VkImageView attachments[] {gpu->swapchain_image_views[i], depth_enabled ? depth_images[i].view : VK_NULL_HANDLE};
+
                 VkFramebufferCreateInfo info
                 {
                     .sType = VKT(FRAMEBUFFER_CREATE_INFO),
                     .renderPass = render_pass,
-                    .attachmentCount = 1,
-                    .pAttachments = &i,
+                    .attachmentCount = depth_enabled ? 2u : 1u,
+                    .pAttachments = attachments,
                     .width = extent.width,
                     .height = extent.height,
                     .layers = 1,
@@ -429,7 +679,20 @@ struct Context
             }
         }
 
-        generic_fragment_shader = load_shader("shader.frag.spv");
+        if(gpu->pipeline_statistics)
+        {
+            VkQueryPoolCreateInfo info
+            {
+                .sType = VKT(QUERY_POOL_CREATE_INFO),
+                .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+                .queryCount = 1,
+                .pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT,
+            };
+            err = vkCreateQueryPool(gpu->device, &info, nullptr, &statistics_pool);
+            check_vk(err);
+        }
+
+        generic_fragment_shader = load_shader(generic_fragment_path);
     }
 
     void build_synchronization()
@@ -450,7 +713,8 @@ struct Context
         {
             VkFenceCreateInfo info
             {
-                .sType = VKT(FENCE_CREATE_INFO)
+                .sType = VKT(FENCE_CREATE_INFO),
+                .flags = VK_FENCE_CREATE_SIGNALED_BIT, // so the first begin_frame doesn't wait on nothing
             };
             err = vkCreateFence(gpu->device, &info, nullptr, &syncs.fence);
             check_vk(err);
@@ -496,11 +760,29 @@ struct Context
         color_blend_info.logicOpEnable = VK_FALSE;
         color_blend_info.attachmentCount = 1;
         color_blend_info.pAttachments = &color_blend_attachment;
+
+        // less or equal so draws sharing a depth, like everything when depth isn't assigned, still pass
+        depth_stencil_info.sType = VKT(PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO);
+        depth_stencil_info.depthTestEnable = VK_TRUE;
+        depth_stencil_info.depthWriteEnable = VK_TRUE;
+        depth_stencil_info.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+        blend_depth_stencil_info = depth_stencil_info;
+        blend_depth_stencil_info.depthWriteEnable = VK_FALSE;
+
+        // the scissor is set per render pass and changed by the draw queue's clip stack
+        dynamic_info.sType = VKT(PIPELINE_DYNAMIC_STATE_CREATE_INFO);
+        dynamic_info.dynamicStateCount = array_size(dynamic_states);
+        dynamic_info.pDynamicStates = dynamic_states;
     }
 
     VkShaderModule load_shader(const String& d)
     {
         VkResult err;
+        if(shader_recording){
+            shader_recording->push_back(d);
+        }
+
         String code;
         std::ifstream f {d, f.binary | f.ate};
 
@@ -524,6 +806,15 @@ struct Context
         return module;
     }
 
+    // for builders, so the pipeline is rebuilt when shader.frag changes
+    VkShaderModule use_generic_fragment()
+    {
+        if(shader_recording){
+            shader_recording->push_back(generic_fragment_path);
+        }
+        return generic_fragment_shader;
+    }
+
     VkGraphicsPipelineCreateInfo new_pipeline_create_info()
     {
         VkGraphicsPipelineCreateInfo info
@@ -535,7 +826,9 @@ struct Context
             .pViewportState = &viewport_info,
             .pRasterizationState = &rasterization_info,
             .pMultisampleState = &multisample_info,
+            .pDepthStencilState = depth_enabled ? &depth_stencil_info : nullptr,
             .pColorBlendState = &color_blend_info, 
+            .pDynamicState = &dynamic_info,
             .renderPass = render_pass,
             .subpass = 0,
         };
@@ -556,27 +849,32 @@ struct Context
     }
 
     void render_reset(const RGBA& color)
+    {
+        begin_frame();
+        begin_render_pass(color);
+    }
+
+    // split from render_reset so work that has to sit outside the render pass
+    // (compute dispatches, buffer fills) can be recorded in between
+    void begin_frame()
     {
         // TODO error handling
-        VkClearValue clear {{{color.r, color.g, color.b, color.a}}};
+        // no timeouts, a slow (software) device must not get its command buffer reset mid flight
+        const auto start {std::chrono::high_resolution_clock::now()};
 
-        vkWaitForFences(gpu->device, 1, &syncs.fence, VK_TRUE, 50000000);
+        vkWaitForFences(gpu->device, 1, &syncs.fence, VK_TRUE, UINT64_MAX);
         vkResetFences(gpu->device, 1, &syncs.fence);
 
+        memory.begin_frame();
+        descriptors.begin_frame();
+        swap_pipelines();
+
         vkResetCommandBuffer(command_buffer, 0);
 
-        VkResult err;
-        vkAcquireNextImageKHR(gpu->device, gpu->swapchain, 50000000, syncs.fetch, VK_NULL_HANDLE, &swapchain_image);
+        vkAcquireNextImageKHR(gpu->device, gpu->swapchain, UINT64_MAX, syncs.fetch, VK_NULL_HANDLE, &swapchain_image);
 
-        VkRenderPassBeginInfo render_pass_begin
-        {
-            .sType = VKT(RENDER_PASS_BEGIN_INFO),
-            .renderPass = render_pass,
-            .framebuffer = framebuffers[swapchain_image],
-            .renderArea {.offset = {0, 0}, .extent = extent},
-            .clearValueCount = 1,
-            .pClearValues = &clear,
-        };
+        record_start = std::chrono::high_resolution_clock::now();
+        timings.acquire = std::chrono::duration<float, std::milli>{record_start - start}.count();
 
         VkCommandBufferBeginInfo buffer_begin_info
         {
@@ -585,17 +883,72 @@ struct Context
         };
 
         vkBeginCommandBuffer(command_buffer, &buffer_begin_info);
+
+        if(statistics_pool)
+        {
+            // the fence above means last frame's query is done
+            if(statistics_pending)
+            {
+                vkGetQueryPoolResults(gpu->device, statistics_pool, 0, 1, sizeof(fragment_invocations), &fragment_invocations,
+                                      sizeof(fragment_invocations), VK_QUERY_RESULT_64_BIT);
+            }
+            vkCmdResetQueryPool(command_buffer, statistics_pool, 0, 1);
+        }
+    }
+
+    void begin_render_pass(const RGBA& color)
+    {
+        VkClearValue clear[2] {};
+        clear[0].color = {{color.r, color.g, color.b, color.a}};
+        clear[1].depthStencil = {1.f, 0};
+
+        VkRenderPassBeginInfo render_pass_begin
+        {
+            .sType = VKT(RENDER_PASS_BEGIN_INFO),
+            .renderPass = render_pass,
+            .framebuffer = framebuffers[swapchain_image],
+            .renderArea {.offset = {0, 0}, .extent = extent},
+            .clearValueCount = depth_enabled ? 2u : 1u,
+            .pClearValues = clear,
+        };
+
         vkCmdBeginRenderPass(command_buffer, &render_pass_begin, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+        in_render_pass = true;
+
+        if(statistics_pool){
+            vkCmdBeginQuery(command_buffer, statistics_pool, 0, 0);
+        }
     }
 
     void present()
     {
         VkResult err;
-        vkCmdEndRenderPass(command_buffer);
+        using Clock = std::chrono::high_resolution_clock;
+        using Milliseconds = std::chrono::duration<float, std::milli>;
+
+        // frames recorded through a render graph manage their own passes
+        if(in_render_pass)
+        {
+            if(statistics_pool)
+            {
+                vkCmdEndQuery(command_buffer, statistics_pool, 0);
+                statistics_pending = true;
+            }
+            vkCmdEndRenderPass(command_buffer);
+            in_render_pass = false;
+        }
+
+        if(read_back_requested){
+            record_read_back();
+        }
 
         vkEndCommandBuffer(command_buffer);
 
-        VkPipelineStageFlags stages[] {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+        auto t {Clock::now()};
+        timings.record = Milliseconds{t - record_start}.count();
+
+        VkPipelineStageFlags stages[] {acquire_wait_stages};
 
         VkSubmitInfo submit
         {
@@ -611,6 +964,15 @@ struct Context
 
         err = vkQueueSubmit(gpu->device_queue, 1, &submit, syncs.fence);
         check_vk(err);
+        frames_presented++;
+        if(swapped_ticket)
+        {
+            presented_ticket = swapped_ticket;
+            swapped_ticket = 0;
+        }
+
+        auto t2 {Clock::now()};
+        timings.submit = Milliseconds{t2 - t}.count();
 
         VkPresentInfoKHR present
         {
@@ -625,6 +987,75 @@ struct Context
         err = vkQueuePresentKHR(gpu->device_queue, &present);
         check_vk(err);
 
+        timings.present = Milliseconds{Clock::now() - t2}.count();
+
+    }
+
+    // the frame being recorded is copied to host memory when it is presented, read_back
+    // then waits for it. only for tests and comparisons, it stalls the frame
+    void request_read_back()
+    {
+        assert(read_back_enabled);
+        if(!read_back_buffer.buffer)
+        {
+            read_back_buffer = create_buffer((VkDeviceSize)extent.width * extent.height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        }
+        read_back_requested = true;
+    }
+
+    void record_read_back()
+    {
+        const auto image {gpu->swapchain_images[swapchain_image]};
+
+        VkImageMemoryBarrier barrier
+        {
+            .sType = VKT(IMAGE_MEMORY_BARRIER),
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = image,
+            .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1},
+        };
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region
+        {
+            .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            .imageExtent = {extent.width, extent.height, 1},
+        };
+        vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, read_back_buffer.buffer, 1, &region);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        read_back_requested = false;
+    }
+
+    // r g b a bytes per pixel, whatever the swapchain order
+    void read_back(Array<u32>& out)
+    {
+        vkWaitForFences(gpu->device, 1, &syncs.fence, VK_TRUE, UINT64_MAX);
+
+        const auto count {extent.width * extent.height};
+        out.resize(count);
+        memcpy(out.data(), read_back_buffer.data, count * 4);
+
+        const auto f {gpu->format.format};
+        if(f == VK_FORMAT_B8G8R8A8_SRGB || f == VK_FORMAT_B8G8R8A8_UNORM)
+        {
+            for(auto& p : out){
+                p = (p & 0xff00ff00) | ((p & 0xff) << 16) | ((p >> 16) & 0xff);
+            }
+        }
     }
 
     float aspect_ratio()
@@ -635,15 +1066,28 @@ struct Context
     V2 norm(const float x, const float y)
     {
         V2 r;
-        r.x = ((float)x / (float)width) * 2.f - 1.f;
-        r.y = ((float)y / (float)height) * 2.f - 1.f;
+        r.x = ((x - view.min.x) / (view.max.x - view.min.x)) * 2.f - 1.f;
+        r.y = ((y - view.min.y) / (view.max.y - view.min.y)) * 2.f - 1.f;
         return r;
     }
 
+    // builders are kept and may run again on another thread, whatever they capture has to outlive the context
+    template<typename F>
+    PipelineSource record_pipeline(F& f, Array<Pipeline>& built)
+    {
+        PipelineSource source {.build = f};
+        shader_recording = &source.shaders;
+        built.push_back(f());
+        shader_recording = nullptr;
+        return source;
+    }
+
     template<typename F>
     u32 add_new_pipeline(F f)
     {
-        pipelines.push_back(f());
+        auto source {record_pipeline(f, pipelines)};
+        std::lock_guard lock {sources_mutex};
+        pipeline_sources.push_back(std::move(source));
         return pipelines.size() - 1;
     }
 
@@ -652,5 +1096,228 @@ struct Context
         return pipelines[id];
     }
 
+    VkComputePipelineCreateInfo new_compute_pipeline_create_info(VkShaderModule module)
+    {
+        VkComputePipelineCreateInfo info
+        {
+            .sType = VKT(COMPUTE_PIPELINE_CREATE_INFO),
+            .stage = new_shader_stage(VK_SHADER_STAGE_COMPUTE_BIT, module),
+        };
+        return info;
+    }
+
+    template<typename F>
+    u32 add_new_compute_pipeline(F f)
+    {
+        auto source {record_pipeline(f, compute_pipelines)};
+        std::lock_guard lock {sources_mutex};
+        compute_pipeline_sources.push_back(std::move(source));
+        return compute_pipelines.size() - 1;
+    }
+
+    // ids of the pipelines built from this shader
+    Array<u32> pipelines_using(const String& shader, const bool compute)
+    {
+        Array<u32> out;
+        std::lock_guard lock {sources_mutex};
+        const auto& sources {compute ? compute_pipeline_sources : pipeline_sources};
+        for(u32 i = 0; i < sources.size(); i++)
+        {
+            const auto& s {sources[i].shaders};
+            if(std::find(s.begin(), s.end(), shader) != s.end()){
+                out.push_back(i);
+            }
+        }
+        return out;
+    }
+
+    // safe off the render thread, the builders only read state that is fixed after init,
+    // apart from generic_fragment_shader, which belongs to the thread calling this
+    Pipeline rebuild_pipeline(const u32 id, const bool compute)
+    {
+        std::function<Pipeline()> build;
+        {
+            std::lock_guard lock {sources_mutex};
+            build = (compute ? compute_pipeline_sources : pipeline_sources)[id].build;
+        }
+        return build();
+    }
+
+    // all of them land in the same frame
+    void queue_pipeline_swaps(const Array<PipelineSwap>& swaps)
+    {
+        std::lock_guard lock {swap_mutex};
+        pending_swaps.insert(pending_swaps.end(), swaps.begin(), swaps.end());
+    }
+
+    void destroy_pipeline(const Pipeline& p)
+    {
+        vkDestroyPipeline(gpu->device, p.pipeline, nullptr);
+        vkDestroyPipelineLayout(gpu->device, p.layout, nullptr);
+    }
+
+    // after the fence, so every frame presented before this one is done with what was retired
+    void swap_pipelines()
+    {
+        auto kept {retired_pipelines.begin()};
+        for(auto& r : retired_pipelines)
+        {
+            if(r.frame < frames_presented){
+                destroy_pipeline(r.pipeline);
+            }
+            else{
+                *kept++ = r;
+            }
+        }
+        retired_pipelines.erase(kept, retired_pipelines.end());
+
+        std::lock_guard lock {swap_mutex};
+        for(auto& s : pending_swaps)
+        {
+            auto& slot {s.compute ? compute_pipelines[s.id] : pipelines[s.id]};
+            retired_pipelines.push_back({slot, frames_presented});
+            slot = s.pipeline;
+            swapped_ticket = std::max(swapped_ticket, s.ticket);
+        }
+        pending_swaps.clear();
+    }
+
+    Pipeline get_compute_pipeline(const int id)
+    {
+        return compute_pipelines[id];
+    }
+
+    u32 find_memory_type(const u32 type_bits, const VkMemoryPropertyFlags flags)
+    {
+        const auto& m {gpu->memory_properties};
+        for(u32 i = 0; i < m.memoryTypeCount; i++)
+        {
+            if((type_bits & (1 << i)) && (m.memoryTypes[i].propertyFlags & flags) == flags){
+                return i;
+            }
+        }
+        assert(false);
+        return 0;
+    }
+
+    Image create_image(const VkExtent2D size, const VkFormat format, const VkImageUsageFlags usage, const VkImageAspectFlags aspect,
+                       const MemoryTelemetry::Category category = MemoryTelemetry::automatic)
+    {
+        Image result;
+        VkResult err;
+
+        VkImageCreateInfo info
+        {
+            .sType = VKT(IMAGE_CREATE_INFO),
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = format,
+            .extent = {size.width, size.height, 1},
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+        err = vkCreateImage(gpu->device, &info, nullptr, &result.image);
+        check_vk(err);
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(gpu->device, result.image, &requirements);
+
+        VkMemoryAllocateInfo allocate_info
+        {
+            .sType = VKT(MEMORY_ALLOCATE_INFO),
+            .allocationSize = requirements.size,
+            .memoryTypeIndex = find_memory_type(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+        };
+        err = vkAllocateMemory(gpu->device, &allocate_info, nullptr, &result.memory);
+        check_vk(err);
+        memory.track(result.memory, category == MemoryTelemetry::automatic ? MemoryTelemetry::image_category(usage) : category,
+                     allocate_info.memoryTypeIndex, allocate_info.allocationSize);
+
+        err = vkBindImageMemory(gpu->device, result.image, result.memory, 0);
+        check_vk(err);
+
+        VkImageViewCreateInfo view_info
+        {
+            .sType = VKT(IMAGE_VIEW_CREATE_INFO),
+            .image = result.image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = format,
+            .subresourceRange = {
+                                  .aspectMask = aspect,
+                                  .baseMipLevel = 0,
+                                  .levelCount = 1,
+                                  .baseArrayLayer = 0,
+                                  .layerCount = 1}
+        };
+        err = vkCreateImageView(gpu->device, &view_info, nullptr, &result.view);
+        check_vk(err);
+
+        return result;
+    }
+
+    Buffer create_buffer(const VkDeviceSize size, const VkBufferUsageFlags usage, const VkMemoryPropertyFlags flags,
+                         const MemoryTelemetry::Category category = MemoryTelemetry::automatic)
+    {
+        Buffer result;
+        VkResult err;
+
+        result.size = size;
+
+        VkBufferCreateInfo info
+        {
+            .sType = VKT(BUFFER_CREATE_INFO),
+            .size = size,
+            .usage = usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+        err = vkCreateBuffer(gpu->device, &info, nullptr, &result.buffer);
+        check_vk(err);
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(gpu->device, result.buffer, &requirements);
+
+        VkMemoryAllocateInfo allocate_info
+        {
+            .sType = VKT(MEMORY_ALLOCATE_INFO),
+            .allocationSize = requirements.size,
+            .memoryTypeIndex = find_memory_type(requirements.memoryTypeBits, flags),
+        };
+        err = vkAllocateMemory(gpu->device, &allocate_info, nullptr, &result.memory);
+        check_vk(err);
+        memory.track(result.memory, category == MemoryTelemetry::automatic ? MemoryTelemetry::buffer_category(usage, flags) : category,
+                     allocate_info.memoryTypeIndex, allocate_info.allocationSize);
+
+        err = vkBindBufferMemory(gpu->device, result.buffer, result.memory, 0);
+        check_vk(err);
+
+        if(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        {
+            err = vkMapMemory(gpu->device, result.memory, 0, VK_WHOLE_SIZE, 0, &result.data);
+            check_vk(err);
+        }
+
+        return result;
+    }
+
+    void destroy_image(Image& image)
+    {
+        vkDestroyImageView(gpu->device, image.view, nullptr);
+        vkDestroyImage(gpu->device, image.image, nullptr);
+        memory.release(image.memory);
+        vkFreeMemory(gpu->device, image.memory, nullptr);
+        image = {};
+    }
+
+    void destroy_buffer(Buffer& buffer)
+    {
+        vkDestroyBuffer(gpu->device, buffer.buffer, nullptr);
+        memory.release(buffer.memory);
+        vkFreeMemory(gpu->device, buffer.memory, nullptr);
+        buffer = {};
+    }
 };
 
@@ -0,0 +1,375 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "types.hpp"
+#include "utilities.hpp"
+
+// transient descriptor sets, valid until the frame they were made for comes around again
+//
+// every frame in flight owns a list of pools that grow by doubling. sets are never freed
+// one by one, the frame's pools are reset wholesale once its fence has signaled. within
+// a frame sets are cached by layout and binding contents, so asking for the same
+// bindings again returns the same set without another vkUpdateDescriptorSets. a layout
+// the ratios can't hold gets overflow pools sized from what it needs
+struct DescriptorAllocator
+{
+    struct Binding
+    {
+        u32 binding;
+        VkDescriptorType type;
+        VkDescriptorBufferInfo buffer; // buffer types
+        VkDescriptorImageInfo image;   // image and sampler types
+    };
+
+    struct Stats
+    {
+        u32 requests {0};
+        u32 cache_hits {0};
+        u32 allocations {0};
+        u32 writes {0};        // descriptors written
+        u32 pools_created {0};
+        u32 pools_reset {0};
+    };
+
+    struct Pool
+    {
+        VkDescriptorPool pool;
+        u32 sets;
+    };
+
+    struct Frame
+    {
+        Array<Pool> pools;
+        u32 current {0}; // pools before it are full
+        Array<Pool> overflow;
+        u32 overflow_current {0};
+        std::unordered_map<String, VkDescriptorSet> cache;
+    };
+
+    using Sizes = Array<VkDescriptorPoolSize>;
+
+    static constexpr u32 first_pool_sets {64};
+    static constexpr u32 max_pool_sets {4096};
+    static constexpr u32 overflow_pool_sets {16};
+
+    // descriptors of each type per set a pool is sized for
+    static constexpr VkDescriptorPoolSize ratios[]
+    {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2},
+        {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1},
+        {VK_DESCRIPTOR_TYPE_SAMPLER, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+    };
+
+    VkDevice device {VK_NULL_HANDLE};
+    Array<Frame> frames;
+    u32 frame {0};
+    String key;
+
+    // descriptors per set of the layouts that didn't fit the ratios, or that were added
+    std::unordered_map<VkDescriptorSetLayout, Sizes> layouts;
+    std::unordered_set<VkDescriptorSetLayout> fitting; // checked against the ratios and fine
+
+    Stats stats;      // since begin_frame
+    Stats totals;     // since init
+
+    // one frame per fence that guards them, the context has one
+    void init(VkDevice d, const u32 frames_in_flight = 1)
+    {
+        device = d;
+        frames.resize(frames_in_flight);
+    }
+
+    // what a set of the layout needs, for layouts with types the ratios leave out or large arrays
+    void add_layout(VkDescriptorSetLayout layout, const VkDescriptorSetLayoutBinding* bindings, const u32 count)
+    {
+        Sizes sizes;
+        for(u32 i = 0; i < count; i++){
+            add_size(sizes, bindings[i].descriptorType, bindings[i].descriptorCount);
+        }
+        layouts[layout] = sizes;
+    }
+
+    static void add_size(Sizes& sizes, const VkDescriptorType type, const u32 count)
+    {
+        for(auto& s : sizes)
+        {
+            if(s.type == type)
+            {
+                s.descriptorCount += count;
+                return;
+            }
+        }
+        sizes.push_back({type, count});
+    }
+
+    // whether every set of the shared pools has room for these
+    static bool fits(const Sizes& sizes)
+    {
+        for(auto& s : sizes)
+        {
+            auto found {false};
+            for(auto& r : ratios)
+            {
+                if(r.type == s.type && s.descriptorCount <= r.descriptorCount){
+                    found = true;
+                }
+            }
+            if(!found){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    VkDescriptorPool create_pool(const u32 sets, const VkDescriptorPoolSize* per_set, const u32 count)
+    {
+        VkResult err;
+
+        Sizes sizes(count);
+        for(u32 i = 0; i < count; i++){
+            sizes[i] = {per_set[i].type, per_set[i].descriptorCount * sets};
+        }
+
+        VkDescriptorPoolCreateInfo info
+        {
+            .sType = VKT(DESCRIPTOR_POOL_CREATE_INFO),
+            .maxSets = sets,
+            .poolSizeCount = count,
+            .pPoolSizes = sizes.data(),
+        };
+
+        VkDescriptorPool pool;
+        err = vkCreateDescriptorPool(device, &info, nullptr, &pool);
+        check_vk(err);
+
+        stats.pools_created++;
+        totals.pools_created++;
+        return pool;
+    }
+
+    // after the fence of the frame about to be recorded, its sets are no longer in use
+    void begin_frame()
+    {
+        frame = (frame + 1) % frames.size();
+        auto& f {frames[frame]};
+
+        stats = {};
+        auto reset {[&](Array<Pool>& pools, u32& current)
+        {
+            for(u32 i = 0; i < pools.size() && i <= current; i++)
+            {
+                vkResetDescriptorPool(device, pools[i].pool, 0);
+                stats.pools_reset++;
+                totals.pools_reset++;
+            }
+            current = 0;
+        }};
+        reset(f.pools, f.current);
+        reset(f.overflow, f.overflow_current);
+        f.cache.clear();
+    }
+
+    bool try_allocate(VkDescriptorPool pool, VkDescriptorSetLayout layout, VkDescriptorSet& set)
+    {
+        VkDescriptorSetAllocateInfo info
+        {
+            .sType = VKT(DESCRIPTOR_SET_ALLOCATE_INFO),
+            .descriptorPool = pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &layout,
+        };
+
+        // anything but full or fragmented is a real error
+        const auto err {vkAllocateDescriptorSets(device, &info, &set)};
+        if(err != VK_ERROR_OUT_OF_POOL_MEMORY && err != VK_ERROR_FRAGMENTED_POOL){
+            check_vk(err);
+        }
+        if(err != VK_SUCCESS){
+            return false;
+        }
+
+        stats.allocations++;
+        totals.allocations++;
+        return true;
+    }
+
+    // the bindings stand in for add_layout, one descriptor each, and decide once whether
+    // the layout fits the ratios. without either it is assumed to, and VK_NULL_HANDLE
+    // comes back if even an empty pool can't hold it
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout, const Binding* bindings = nullptr, const u32 count = 0)
+    {
+        auto& f {frames[frame]};
+        VkDescriptorSet set;
+
+        auto needs {layouts.find(layout)};
+        if(needs == layouts.end() && bindings && !fitting.count(layout))
+        {
+            Sizes sizes;
+            for(u32 i = 0; i < count; i++){
+                add_size(sizes, bindings[i].type, 1);
+            }
+
+            if(fits(sizes)){
+                fitting.insert(layout);
+            }
+            else{
+                needs = layouts.emplace(layout, sizes).first;
+            }
+        }
+
+        while(needs == layouts.end())
+        {
+            auto fresh {false};
+            if(f.current == f.pools.size())
+            {
+                const auto sets {f.pools.empty() ? first_pool_sets : std::min(f.pools.back().sets * 2, max_pool_sets)};
+                f.pools.push_back({create_pool(sets, ratios, array_size(ratios)), sets});
+                fresh = true;
+            }
+
+            if(try_allocate(f.pools[f.current].pool, layout, set)){
+                return set;
+            }
+
+            // an empty pool that can't hold one set never will, however large
+            if(fresh)
+            {
+                fprintf(stderr, "descriptors: layout doesn't fit the pool ratios, add_layout it\n");
+                assert(false);
+                return VK_NULL_HANDLE;
+            }
+
+            // this pool is full, later frames start on the next one right away
+            f.current++;
+        }
+
+        while(true)
+        {
+            auto fresh {false};
+            if(f.overflow_current == f.overflow.size())
+            {
+                const auto& sizes {needs->second};
+                f.overflow.push_back({create_pool(overflow_pool_sets, sizes.data(), sizes.size()), overflow_pool_sets});
+                fresh = true;
+            }
+
+            if(try_allocate(f.overflow[f.overflow_current].pool, layout, set)){
+                return set;
+            }
+
+            if(fresh)
+            {
+                fprintf(stderr, "descriptors: layout doesn't fit a pool sized for it\n");
+                assert(false);
+                return VK_NULL_HANDLE;
+            }
+            f.overflow_current++;
+        }
+    }
+
+    static bool is_image(const VkDescriptorType type)
+    {
+        return type == VK_DESCRIPTOR_TYPE_SAMPLER || type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+               type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE || type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+               type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    }
+
+    template<typename T>
+    void append(const T& v)
+    {
+        key.append((const char*)&v, sizeof(v));
+    }
+
+    // a set of the layout with these bindings, written only when it isn't cached yet
+    VkDescriptorSet get(VkDescriptorSetLayout layout, const Binding* bindings, const u32 count)
+    {
+        stats.requests++;
+        totals.requests++;
+
+        // field by field, struct padding would make equal bindings differ
+        key.clear();
+        append(layout);
+        for(u32 i = 0; i < count; i++)
+        {
+            const auto& b {bindings[i]};
+            append(b.binding);
+            append(b.type);
+            if(is_image(b.type))
+            {
+                append(b.image.sampler);
+                append(b.image.imageView);
+                append(b.image.imageLayout);
+            }
+            else
+            {
+                append(b.buffer.buffer);
+                append(b.buffer.offset);
+                append(b.buffer.range);
+            }
+        }
+
+        auto& f {frames[frame]};
+        const auto it {f.cache.find(key)};
+        if(it != f.cache.end())
+        {
+            stats.cache_hits++;
+            totals.cache_hits++;
+            return it->second;
+        }
+
+        const auto set {allocate(layout, bindings, count)};
+        if(!set){
+            return VK_NULL_HANDLE;
+        }
+
+        VkWriteDescriptorSet writes[16];
+        assert(count <= array_size(writes));
+        for(u32 i = 0; i < count; i++)
+        {
+            const auto& b {bindings[i]};
+            writes[i] =
+            {
+                .sType = VKT(WRITE_DESCRIPTOR_SET),
+                .dstSet = set,
+                .dstBinding = b.binding,
+                .descriptorCount = 1,
+                .descriptorType = b.type,
+                .pImageInfo = is_image(b.type) ? &b.image : nullptr,
+                .pBufferInfo = is_image(b.type) ? nullptr : &b.buffer,
+            };
+        }
+        vkUpdateDescriptorSets(device, count, writes, 0, nullptr);
+        stats.writes += count;
+        totals.writes += count;
+
+        f.cache.emplace(key, set);
+        return set;
+    }
+
+    void destroy()
+    {
+        for(auto& f : frames)
+        {
+            for(auto& p : f.pools){
+                vkDestroyDescriptorPool(device, p.pool, nullptr);
+            }
+            for(auto& p : f.overflow){
+                vkDestroyDescriptorPool(device, p.pool, nullptr);
+            }
+            f.pools.clear();
+            f.overflow.clear();
+            f.cache.clear();
+        }
+    }
+};
@@ -0,0 +1,487 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "context.hpp"
+
+// draws are recorded into the queue instead of the command buffer, sorted by a
+// 64 bit key at flush and emitted with redundant binds and push constants dropped
+//
+// opaque layers:      layer:8 | pipeline:12 | texture:12 | depth:32
+// translucent layers: layer:8 |     0:24                 | sequence:32
+//
+// translucent layers keep submission order, the sort is stable so equal keys do too
+//
+// with painter_depth every draw gets a depth from its submission order, later is
+// closer, so opaque draws can go first and front to back regardless of layer:
+//
+// opaque:             0:1 | 0:7     | pipeline:12 | texture:12 | depth:32
+// translucent:        1:1 | layer:7 |     0:24                 | sequence:32
+//
+// clip rects are a stack, each one the intersection with its parent. triangles are
+// trimmed to the clip at push when that leaves at most trim_vertices corners, are dropped
+// when outside and keep the whole target when inside, so only the rest needs a scissor.
+// flush only changes the scissor when a draw would come out different under the current one
+struct DrawQueue
+{
+    static constexpr u32 push_size {24 * sizeof(float)};
+
+    struct Draw
+    {
+        u32 pipeline;
+        u32 vertex_count;
+        u32 texture;
+        u32 clip; // into clip_rects, 0 when unclipped
+        float depth;
+        u8 layer;
+        float data[24];
+    };
+
+    struct SortItem
+    {
+        u64 key;
+        u32 index;
+    };
+
+    struct Stats
+    {
+        u32 draws {0};
+        u32 binds_unsorted {0}; // what issuing in call order would have cost
+        u32 binds {0};
+        u32 pushes {0};
+        u32 pushes_skipped {0};
+
+        // clip stack costs, counted at push and reported by the next flush
+        u32 trimmed {0};        // clipped on the cpu
+        u32 trim_draws {0};     // draws those turned into
+        u32 clip_culled {0};    // entirely outside their clip
+        u32 scissored {0};      // left to the scissor
+        u32 scissor_changes {0};
+        u32 batch_breaks {0};   // scissor changes between draws of the same pipeline
+    };
+
+    Array<Draw> draws;
+    Array<SortItem> items;
+    Array<SortItem> scratch;
+
+    bool translucent[256] {};
+    u8 layer {0};
+    u32 texture {0};
+
+    bool painter_depth {false};
+
+    // ndc, min inclusive max exclusive. the first is the whole target
+    Array<Rect> clip_rects {{{-1.f, -1.f}, {1.f, 1.f}}};
+    Array<u32> clip_stack;
+
+    // most corners a trimmed triangle may keep, 4 means one or two draws, 0 always scissors
+    u32 trim_vertices {4};
+
+    Stats stats;
+    Stats pending;
+
+    void set_translucent(const u8 l, const bool t = true)
+    {
+        translucent[l] = t;
+    }
+
+    static u32 depth_bits(const float depth)
+    {
+        // non negative floats sort the same as their bit patterns, front to back
+        u32 bits;
+        const auto d {depth < 0.f ? 0.f : depth};
+        memcpy(&bits, &d, sizeof(bits));
+        return bits;
+    }
+
+    // in ndc like the draw data, use Context::norm on the corners
+    void push_clip(Rect r)
+    {
+        if(!clip_stack.empty())
+        {
+            const auto& parent {clip_rects[clip_stack.back()]};
+            r.min = {std::max(r.min.x, parent.min.x), std::max(r.min.y, parent.min.y)};
+            r.max = {std::min(r.max.x, parent.max.x), std::min(r.max.y, parent.max.y)};
+        }
+        clip_stack.push_back(clip_rects.size());
+        clip_rects.push_back(r);
+    }
+
+    void pop_clip()
+    {
+        clip_stack.pop_back();
+    }
+
+    void add(const u32 pipeline, const float* data, const float depth, const u32 vertex_count, const u32 clip)
+    {
+        Draw d;
+        d.pipeline = pipeline;
+        d.vertex_count = vertex_count;
+        d.texture = texture;
+        d.clip = clip;
+        d.depth = depth;
+        d.layer = layer;
+        memcpy(d.data, data, push_size);
+        draws.push_back(d);
+    }
+
+    void push(const u32 pipeline, const float* data, const float depth = 0.f, const u32 vertex_count = 3)
+    {
+        const auto clip {clip_stack.empty() ? 0u : clip_stack.back()};
+        if(!clip){
+            add(pipeline, data, depth, vertex_count, 0);
+        }
+        else if(vertex_count != 3)
+        {
+            // nothing known about the geometry
+            pending.scissored++;
+            add(pipeline, data, depth, vertex_count, clip);
+        }
+        else{
+            push_clipped(pipeline, data, depth, clip);
+        }
+    }
+
+    // one triangle, xyzw positions then rgba colors, against an axis aligned rect
+    void push_clipped(const u32 pipeline, const float* data, const float depth, const u32 clip)
+    {
+        const auto& r {clip_rects[clip]};
+
+        float x0 {data[0]};
+        float y0 {data[1]};
+        float x1 {x0};
+        float y1 {y0};
+        for(int i = 1; i < 3; i++)
+        {
+            x0 = std::min(x0, data[i * 4]);
+            y0 = std::min(y0, data[i * 4 + 1]);
+            x1 = std::max(x1, data[i * 4]);
+            y1 = std::max(y1, data[i * 4 + 1]);
+        }
+
+        if(x1 <= r.min.x || y1 <= r.min.y || x0 >= r.max.x || y0 >= r.max.y || r.min.x >= r.max.x || r.min.y >= r.max.y)
+        {
+            pending.clip_culled++;
+            return;
+        }
+        if(x0 >= r.min.x && y0 >= r.min.y && x1 <= r.max.x && y1 <= r.max.y)
+        {
+            add(pipeline, data, depth, 3, 0);
+            return;
+        }
+
+        // sutherland hodgman over xyzw and rgba, everything is linear in screen space
+        constexpr int attributes {8};
+        float polygon[2][9][attributes];
+        int count {3};
+        for(int i = 0; i < 3; i++)
+        {
+            memcpy(polygon[0][i], data + i * 4, sizeof(float) * 4);
+            memcpy(polygon[0][i] + 4, data + 12 + i * 4, sizeof(float) * 4);
+        }
+
+        const struct { int axis; float bound; float sign; } planes[4]
+        {
+            {0, r.min.x, 1.f}, {0, r.max.x, -1.f}, {1, r.min.y, 1.f}, {1, r.max.y, -1.f},
+        };
+
+        int current {0};
+        for(auto& p : planes)
+        {
+            auto& in {polygon[current]};
+            auto& out {polygon[current ^ 1]};
+            int n {0};
+            for(int i = 0; i < count; i++)
+            {
+                const auto* a {in[i]};
+                const auto* b {in[(i + 1) % count]};
+                const auto da {(a[p.axis] - p.bound) * p.sign};
+                const auto db {(b[p.axis] - p.bound) * p.sign};
+                if(da >= 0.f){
+                    memcpy(out[n++], a, sizeof(float) * attributes);
+                }
+                if((da >= 0.f) != (db >= 0.f))
+                {
+                    const auto t {da / (da - db)};
+                    for(int k = 0; k < attributes; k++){
+                        out[n][k] = a[k] + (b[k] - a[k]) * t;
+                    }
+                    out[n][p.axis] = p.bound;
+                    n++;
+                }
+            }
+            count = n;
+            current ^= 1;
+        }
+
+        if(count < 3)
+        {
+            pending.clip_culled++;
+            return;
+        }
+
+        if((u32)count > trim_vertices)
+        {
+            pending.scissored++;
+            add(pipeline, data, depth, 3, clip);
+            return;
+        }
+
+        pending.trimmed++;
+        const auto& v {polygon[current]};
+        for(int i = 1; i + 1 < count; i++)
+        {
+            float triangle[24];
+            const int corners[3] {0, i, i + 1};
+            for(int k = 0; k < 3; k++)
+            {
+                memcpy(triangle + k * 4, v[corners[k]], sizeof(float) * 4);
+                memcpy(triangle + 12 + k * 4, v[corners[k]] + 4, sizeof(float) * 4);
+            }
+            add(pipeline, triangle, depth, 3, 0);
+            pending.trim_draws++;
+        }
+    }
+
+    // in pixels of a target of the given size
+    VkRect2D scissor(const u32 clip, const VkExtent2D extent) const
+    {
+        const auto& r {clip_rects[clip]};
+        auto px {[&](const float v, const u32 size){ return std::clamp((int)lroundf((v + 1.f) * 0.5f * size), 0, (int)size); }};
+        const auto x0 {px(r.min.x, extent.width)};
+        const auto y0 {px(r.min.y, extent.height)};
+        const auto x1 {std::max(px(r.max.x, extent.width), x0)};
+        const auto y1 {std::max(px(r.max.y, extent.height), y0)};
+        return {{x0, y0}, {(u32)(x1 - x0), (u32)(y1 - y0)}};
+    }
+
+    // clip indices stay valid while they are on the stack, the rest go with the draws
+    void reset_clips()
+    {
+        Array<Rect> kept {clip_rects[0]};
+        for(auto& i : clip_stack)
+        {
+            kept.push_back(clip_rects[i]);
+            i = kept.size() - 1;
+        }
+        clip_rects.swap(kept);
+    }
+
+    void build_keys()
+    {
+        const u32 n = draws.size();
+        items.resize(n);
+
+        for(u32 i = 0; i < n; i++)
+        {
+            auto& d {draws[i]};
+
+            if(painter_depth)
+            {
+                // z of the three vertices in the push constant block
+                d.depth = 1.f - (float)(i + 1) / (float)(n + 1);
+                d.data[2] = d.data[6] = d.data[10] = d.depth;
+            }
+
+            u64 key;
+            if(translucent[d.layer])
+            {
+                key = painter_depth ? (1ull << 63) | ((u64)(d.layer & 0x7f) << 56) : (u64)d.layer << 56;
+                key |= i;
+            }
+            else
+            {
+                key = painter_depth ? 0 : (u64)d.layer << 56;
+                key |= (u64)(d.pipeline & 0xfff) << 44;
+                key |= (u64)(d.texture & 0xfff) << 32;
+                key |= depth_bits(d.depth);
+            }
+            items[i] = {key, i};
+        }
+    }
+
+    // lsd radix sort, 8 bits per pass, passes where every key shares the byte are skipped
+    void sort()
+    {
+        const auto n {items.size()};
+        scratch.resize(n);
+
+        u32 histograms[8][256] {};
+        for(auto& i : items)
+        {
+            for(int b = 0; b < 8; b++){
+                histograms[b][(i.key >> (b * 8)) & 0xff]++;
+            }
+        }
+
+        auto* src {items.data()};
+        auto* dst {scratch.data()};
+
+        for(int b = 0; b < 8; b++)
+        {
+            auto& h {histograms[b]};
+            if(h[(src[0].key >> (b * 8)) & 0xff] == n){
+                continue;
+            }
+
+            u32 offsets[256];
+            u32 sum {0};
+            for(int i = 0; i < 256; i++)
+            {
+                offsets[i] = sum;
+                sum += h[i];
+            }
+
+            for(size_t i = 0; i < n; i++){
+                dst[offsets[(src[i].key >> (b * 8)) & 0xff]++] = src[i];
+            }
+            std::swap(src, dst);
+        }
+
+        if(src != items.data()){
+            items.swap(scratch);
+        }
+    }
+
+    // records into the frame's command buffer unless another one is given
+    void flush(Context& context, VkCommandBuffer target = VK_NULL_HANDLE)
+    {
+        stats = pending;
+        pending = {};
+        stats.draws = draws.size();
+
+        if(draws.empty())
+        {
+            reset_clips();
+            return;
+        }
+
+        {
+            u32 last {~0u};
+            for(auto& d : draws)
+            {
+                if(d.pipeline != last)
+                {
+                    stats.binds_unsorted++;
+                    last = d.pipeline;
+                }
+            }
+        }
+
+        build_keys();
+        sort();
+
+        const auto cmd {target ? target : context.command_buffer};
+
+        u32 bound {~0u};
+        VkPipelineLayout layout {VK_NULL_HANDLE};
+        const float* pushed {nullptr};
+
+        // the render pass starts with the whole target as scissor
+        const auto extent {context.extent};
+        const VkRect2D full {{0, 0}, extent};
+        auto current {full};
+
+        Array<VkRect2D> scissors(clip_rects.size());
+        for(u32 c = 0; c < clip_rects.size(); c++){
+            scissors[c] = scissor(c, extent);
+        }
+
+        auto intersect {[](const VkRect2D& a, const VkRect2D& b)
+        {
+            const auto x0 {std::max(a.offset.x, b.offset.x)};
+            const auto y0 {std::max(a.offset.y, b.offset.y)};
+            const auto x1 {std::max(std::min(a.offset.x + (int)a.extent.width, b.offset.x + (int)b.extent.width), x0)};
+            const auto y1 {std::max(std::min(a.offset.y + (int)a.extent.height, b.offset.y + (int)b.extent.height), y0)};
+            return VkRect2D{{x0, y0}, {(u32)(x1 - x0), (u32)(y1 - y0)}};
+        }};
+
+        auto same {[](const VkRect2D& a, const VkRect2D& b)
+        {
+            return a.offset.x == b.offset.x && a.offset.y == b.offset.y && a.extent.width == b.extent.width && a.extent.height == b.extent.height;
+        }};
+
+        // whether a triangle is cut the same by both rects, then the scissor can stay
+        auto equivalent {[&](const Draw& d, const VkRect2D& a, const VkRect2D& b)
+        {
+            if(same(a, b)){
+                return true;
+            }
+            if(d.vertex_count != 3){
+                return false;
+            }
+
+            float x0 {d.data[0]};
+            float y0 {d.data[1]};
+            float x1 {x0};
+            float y1 {y0};
+            for(int i = 1; i < 3; i++)
+            {
+                x0 = std::min(x0, d.data[i * 4]);
+                y0 = std::min(y0, d.data[i * 4 + 1]);
+                x1 = std::max(x1, d.data[i * 4]);
+                y1 = std::max(y1, d.data[i * 4 + 1]);
+            }
+            const auto bx {(int)floorf((x0 + 1.f) * 0.5f * extent.width)};
+            const auto by {(int)floorf((y0 + 1.f) * 0.5f * extent.height)};
+            const VkRect2D bounds {{bx, by}, {(u32)std::max((int)ceilf((x1 + 1.f) * 0.5f * extent.width) - bx, 0),
+                                              (u32)std::max((int)ceilf((y1 + 1.f) * 0.5f * extent.height) - by, 0)}};
+            return same(intersect(bounds, a), intersect(bounds, b));
+        }};
+
+        for(auto& i : items)
+        {
+            const auto& d {draws[i.index]};
+
+            const auto& target {scissors[d.clip]};
+            if(!equivalent(d, current, target))
+            {
+                vkCmdSetScissor(cmd, 0, 1, &target);
+                stats.scissor_changes++;
+                if(d.pipeline == bound){
+                    stats.batch_breaks++;
+                }
+                current = target;
+            }
+
+            if(d.pipeline != bound)
+            {
+                const auto& pl {context.get_pipeline(d.pipeline)};
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pl.pipeline);
+                stats.binds++;
+                bound = d.pipeline;
+
+                // push constants only carry over between identical layouts
+                if(pl.layout != layout)
+                {
+                    layout = pl.layout;
+                    pushed = nullptr;
+                }
+            }
+
+            if(pushed && memcmp(pushed, d.data, push_size) == 0){
+                stats.pushes_skipped++;
+            }
+            else
+            {
+                vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, push_size, d.data);
+                stats.pushes++;
+                pushed = d.data;
+            }
+
+            vkCmdDraw(cmd, d.vertex_count, 1, 0, 0);
+        }
+
+        if(!same(current, full))
+        {
+            vkCmdSetScissor(cmd, 0, 1, &full);
+            stats.scissor_changes++;
+        }
+
+        draws.clear();
+        items.clear();
+        reset_clips();
+    }
+};
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+
+#include "context.hpp"
+#include "types.hpp"
+
+// captured render_triangle calls, before rotation and normalization so replay runs
+// the same cpu path as the live loop
+//
+// file: header, then per frame clear:RGBA | count:u32 | triangles
+// triangle: pipeline:u16 | layer:u8 | flags:u8 | a b c | rotation | [mid] | color or 3 colors
+//
+// frames are appended as they end, there is no frame count so a capture cut short
+// by a crash still replays up to the last complete frame. pipeline ids depend on which
+// subsystems the capturing run created, so the header records how many there were
+struct DrawStream
+{
+    static constexpr u32 magic {0x52545344}; // "DSTR"
+    static constexpr u32 version {2};
+
+    enum : u8
+    {
+        has_mid = 1 << 0,
+        uniform_color = 1 << 1,
+    };
+
+    struct Header
+    {
+        u32 magic;
+        u32 version;
+        u32 width;
+        u32 height;
+        u32 pipelines;
+    };
+
+    struct Triangle
+    {
+        u32 pipeline;
+        u8 layer;
+        u8 flags;
+        V2 a;
+        V2 b;
+        V2 c;
+        float rotation;
+        V2 mid;
+        RGBA colors[3];
+    };
+
+    struct Frame
+    {
+        RGBA clear;
+        u32 first;
+        u32 count;
+    };
+
+    Array<Frame> frames;
+    Array<Triangle> triangles;
+    u32 width {0};
+    u32 height {0};
+    u32 pipelines {0};
+
+    FILE* file {nullptr};
+    Array<u8> bytes;
+
+    bool open(const char* path, const u32 w, const u32 h, const u32 pipeline_count)
+    {
+        file = fopen(path, "wb");
+        if(!file){
+            return false;
+        }
+
+        width = w;
+        height = h;
+        pipelines = pipeline_count;
+
+        const Header header {magic, version, w, h, pipeline_count};
+        fwrite(&header, sizeof(header), 1, file);
+        return true;
+    }
+
+    void close()
+    {
+        if(file)
+        {
+            fclose(file);
+            file = nullptr;
+        }
+    }
+
+    bool capturing() const
+    {
+        return file != nullptr;
+    }
+
+    void begin_frame(const RGBA& clear)
+    {
+        frames.push_back({clear, (u32)triangles.size(), 0});
+    }
+
+    void add(const u32 pipeline, const u8 layer, V2 a, V2 b, V2 c, const RGBA& ca, const RGBA& cb, const RGBA& cc, const float rotation, const V2 mid)
+    {
+        // draws outside a captured frame, e.g. the indirect bench, are not recorded
+        if(frames.empty()){
+            return;
+        }
+
+        Triangle t {.pipeline = pipeline, .layer = layer, .flags = 0, .a = a, .b = b, .c = c, .rotation = rotation, .mid = mid, .colors = {ca, cb, cc}};
+        if(mid.x != FLT_MAX){
+            t.flags |= has_mid;
+        }
+        if(same(ca, cb) && same(ca, cc)){
+            t.flags |= uniform_color;
+        }
+        triangles.push_back(t);
+        frames.back().count++;
+    }
+
+    // one write per frame, only the current frame is kept in memory while capturing
+    void end_frame()
+    {
+        if(!file || frames.empty()){
+            return;
+        }
+
+        const auto& f {frames.back()};
+        bytes.clear();
+        put(f.clear);
+        put(f.count);
+
+        for(u32 i = 0; i < f.count; i++)
+        {
+            const auto& t {triangles[f.first + i]};
+            put((u16)t.pipeline);
+            put(t.layer);
+            put(t.flags);
+            put(t.a);
+            put(t.b);
+            put(t.c);
+            put(t.rotation);
+            if(t.flags & has_mid){
+                put(t.mid);
+            }
+            put(t.colors[0]);
+            if(!(t.flags & uniform_color))
+            {
+                put(t.colors[1]);
+                put(t.colors[2]);
+            }
+        }
+
+        fwrite(bytes.data(), 1, bytes.size(), file);
+        fflush(file);
+
+        frames.clear();
+        triangles.clear();
+    }
+
+    // fails on triangles with a pipeline id of pipeline_count or more, they can't be replayed
+    bool load(const char* path, const u32 pipeline_count)
+    {
+        auto* f {fopen(path, "rb")};
+        if(!f){
+            return false;
+        }
+
+        Array<u8> data;
+        u8 chunk[1 << 16];
+        size_t n;
+        while((n = fread(chunk, 1, sizeof(chunk), f)) > 0){
+            data.insert(data.end(), chunk, chunk + n);
+        }
+        fclose(f);
+
+        Header header;
+        if(data.size() < sizeof(header)){
+            return false;
+        }
+        memcpy(&header, data.data(), sizeof(header));
+        if(header.magic != magic || header.version != version){
+            return false;
+        }
+
+        width = header.width;
+        height = header.height;
+        pipelines = header.pipelines;
+        frames.clear();
+        triangles.clear();
+
+        const u8* p {data.data() + sizeof(header)};
+        const u8* end {data.data() + data.size()};
+
+        auto get {[&](auto& v)
+        {
+            if(p + sizeof(v) > end){
+                return false;
+            }
+            memcpy(&v, p, sizeof(v));
+            p += sizeof(v);
+            return true;
+        }};
+
+        while(p < end)
+        {
+            Frame frame {};
+            if(!get(frame.clear) || !get(frame.count)){
+                break;
+            }
+            frame.first = triangles.size();
+
+            auto complete {true};
+            for(u32 i = 0; i < frame.count && complete; i++)
+            {
+                Triangle t {};
+                u16 pipeline;
+                complete = get(pipeline) && get(t.layer) && get(t.flags) && get(t.a) && get(t.b) && get(t.c) && get(t.rotation);
+                t.pipeline = pipeline;
+                if(complete && t.pipeline >= pipeline_count)
+                {
+                    fprintf(stderr, "%s: pipeline %u of %u\n", path, t.pipeline, pipeline_count);
+                    return false;
+                }
+                t.mid = {FLT_MAX, FLT_MAX};
+                if(complete && (t.flags & has_mid)){
+                    complete = get(t.mid);
+                }
+                if(complete){
+                    complete = get(t.colors[0]);
+                }
+                if(complete && (t.flags & uniform_color)){
+                    t.colors[1] = t.colors[2] = t.colors[0];
+                }
+                else if(complete){
+                    complete = get(t.colors[1]) && get(t.colors[2]);
+                }
+                triangles.push_back(t);
+            }
+
+            if(!complete)
+            {
+                triangles.resize(frame.first);
+                break;
+            }
+            frames.push_back(frame);
+        }
+        return true;
+    }
+
+    template<typename T>
+    void put(const T& v)
+    {
+        const auto* b {(const u8*)&v};
+        bytes.insert(bytes.end(), b, b + sizeof(v));
+    }
+
+    static bool same(const RGBA& a, const RGBA& b)
+    {
+        return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+    }
+};
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <cstring>
+
+#include "context.hpp"
+#include "utilities.hpp"
+
+// same layout as the push constant block of the immediate pipelines, but with
+// the vertices already in normalized device coordinates
+struct IndirectObject
+{
+    V4 a[3];
+    RGBA b[3];
+};
+
+// objects live in a storage buffer, cull.comp rejects everything outside the
+// scissor and compacts the survivors into draw commands in submission order, the
+// draw itself is a single vkCmdDrawIndirectCount so the cpu cost doesn't grow with
+// the object count
+struct IndirectScene
+{
+    Context* context {nullptr};
+
+    Buffer objects;
+    Buffer commands;
+    Buffer count;
+    Buffer groups; // visible objects per cull group, then their first command
+    u32 capacity {0};
+    u32 object_count {0};
+
+    VkDescriptorSetLayout set_layout;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet set;
+
+    u32 cull_pipeline;
+    u32 scan_pipeline;
+    u32 draw_pipeline;
+
+    static constexpr u32 group_size {64};
+
+    struct CullData
+    {
+        V4 bounds; // ndc min x, min y, max x, max y
+        u32 object_count;
+        u32 pass; // 0 counts per group, 1 writes the commands
+    };
+
+    struct ScanData
+    {
+        u32 group_count;
+    };
+
+    static u32 group_count(const u32 objects)
+    {
+        return (objects + group_size - 1) / group_size;
+    }
+
+    void init(Context& c, const u32 max_objects)
+    {
+        VkResult err;
+
+        context = &c;
+        capacity = max_objects;
+
+        assert(c.gpu->draw_indirect_count && c.gpu->draw_indirect_first_instance);
+
+        objects = c.create_buffer(sizeof(IndirectObject) * capacity,
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        commands = c.create_buffer(sizeof(VkDrawIndirectCommand) * capacity,
+                                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        count = c.create_buffer(sizeof(u32),
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        groups = c.create_buffer(sizeof(u32) * group_count(capacity),
+                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        {
+            VkDescriptorSetLayoutBinding bindings[4] {};
+            for(u32 i = 0; i < array_size(bindings); i++)
+            {
+                bindings[i].binding = i;
+                bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                bindings[i].descriptorCount = 1;
+                bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            }
+            bindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+            VkDescriptorSetLayoutCreateInfo info
+            {
+                .sType = VKT(DESCRIPTOR_SET_LAYOUT_CREATE_INFO),
+                .bindingCount = array_size(bindings),
+                .pBindings = bindings,
+            };
+            err = vkCreateDescriptorSetLayout(c.gpu->device, &info, nullptr, &set_layout);
+            check_vk(err);
+        }
+
+        {
+            VkDescriptorPoolSize size
+            {
+                .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 4,
+            };
+
+            VkDescriptorPoolCreateInfo info
+            {
+                .sType = VKT(DESCRIPTOR_POOL_CREATE_INFO),
+                .maxSets = 1,
+                .poolSizeCount = 1,
+                .pPoolSizes = &size,
+            };
+            err = vkCreateDescriptorPool(c.gpu->device, &info, nullptr, &descriptor_pool);
+            check_vk(err);
+
+            VkDescriptorSetAllocateInfo allocate_info
+            {
+                .sType = VKT(DESCRIPTOR_SET_ALLOCATE_INFO),
+                .descriptorPool = descriptor_pool,
+                .descriptorSetCount = 1,
+                .pSetLayouts = &set_layout,
+            };
+            err = vkAllocateDescriptorSets(c.gpu->device, &allocate_info, &set);
+            check_vk(err);
+        }
+
+        {
+            VkDescriptorBufferInfo buffers[4]
+            {
+                {.buffer = objects.buffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                {.buffer = commands.buffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                {.buffer = count.buffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                {.buffer = groups.buffer, .offset = 0, .range = VK_WHOLE_SIZE},
+            };
+
+            VkWriteDescriptorSet writes[4] {};
+            for(u32 i = 0; i < array_size(writes); i++)
+            {
+                writes[i].sType = VKT(WRITE_DESCRIPTOR_SET);
+                writes[i].dstSet = set;
+                writes[i].dstBinding = i;
+                writes[i].descriptorCount = 1;
+                writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                writes[i].pBufferInfo = &buffers[i];
+            }
+            vkUpdateDescriptorSets(c.gpu->device, array_size(writes), writes, 0, nullptr);
+        }
+
+        auto compute_pipeline {[&](const char* shader, const u32 constant_size)
+        {
+            return c.add_new_compute_pipeline([&c, this, shader, constant_size]() -> Pipeline
+            {
+                Pipeline result;
+                VkResult err;
+
+                auto compute {c.load_shader(shader)};
+
+                VkPushConstantRange constant
+                {
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .offset = 0,
+                    .size = constant_size,
+                };
+
+                VkPipelineLayoutCreateInfo layout_info
+                {
+                    .sType = VKT(PIPELINE_LAYOUT_CREATE_INFO),
+                    .setLayoutCount = 1,
+                    .pSetLayouts = &set_layout,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &constant,
+                };
+
+                err = vkCreatePipelineLayout(c.gpu->device, &layout_info, nullptr, &result.layout);
+                check_vk(err);
+
+                auto info {c.new_compute_pipeline_create_info(compute)};
+                info.layout = result.layout;
+                err = vkCreateComputePipelines(c.gpu->device, VK_NULL_HANDLE, 1, &info, nullptr, &result.pipeline);
+                check_vk(err);
+                vkDestroyShaderModule(c.gpu->device, compute, nullptr);
+                return result;
+            });
+        }};
+
+        cull_pipeline = compute_pipeline("cull.comp.spv", sizeof(CullData));
+        scan_pipeline = compute_pipeline("cull_scan.comp.spv", sizeof(ScanData));
+
+        draw_pipeline = c.add_new_pipeline([&c, this]() -> Pipeline
+        {
+            Pipeline result;
+            VkResult err;
+            auto info {c.new_pipeline_create_info()};
+
+            auto vertex {c.load_shader("indirect.vert.spv")};
+
+            const auto shader_count {2};
+
+            info.stageCount = shader_count;
+
+            VkPipelineShaderStageCreateInfo shader_stages[shader_count] {};
+
+            shader_stages[0] = c.new_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vertex);
+            shader_stages[1] = c.new_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, c.use_generic_fragment());
+            info.pStages = shader_stages;
+
+            VkPipelineLayoutCreateInfo layout_info
+            {
+                .sType = VKT(PIPELINE_LAYOUT_CREATE_INFO),
+                .setLayoutCount = 1,
+                .pSetLayouts = &set_layout,
+            };
+
+            err = vkCreatePipelineLayout(c.gpu->device, &layout_info, nullptr, &result.layout);
+            check_vk(err);
+
+            info.layout = result.layout;
+            err = vkCreateGraphicsPipelines(c.gpu->device, VK_NULL_HANDLE, 1, &info, nullptr, &result.pipeline);
+            check_vk(err);
+            vkDestroyShaderModule(c.gpu->device, vertex, nullptr);
+            return result;
+        });
+    }
+
+    void set_objects(const IndirectObject* data, const u32 n)
+    {
+        assert(n <= capacity);
+        memcpy(objects.data, data, sizeof(IndirectObject) * n);
+        object_count = n;
+    }
+
+    // has to be recorded between Context::begin_frame and Context::begin_render_pass
+    void cull()
+    {
+        auto& c {*context};
+        auto cmd {c.command_buffer};
+
+        const auto barrier {[cmd](VkBuffer buffer, VkAccessFlags dst_access, VkPipelineStageFlags dst_stage)
+        {
+            VkBufferMemoryBarrier b
+            {
+                .sType = VKT(BUFFER_MEMORY_BARRIER),
+                .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                .dstAccessMask = dst_access,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .buffer = buffer,
+                .offset = 0,
+                .size = VK_WHOLE_SIZE,
+            };
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dst_stage, 0, 0, nullptr, 1, &b, 0, nullptr);
+        }};
+
+        const auto groups_needed {group_count(object_count)};
+
+        const auto lo {c.norm(c.scissor.offset.x, c.scissor.offset.y)};
+        const auto hi {c.norm(c.scissor.offset.x + c.scissor.extent.width, c.scissor.offset.y + c.scissor.extent.height)};
+
+        CullData data
+        {
+            .bounds = {lo.x, lo.y, hi.x, hi.y},
+            .object_count = object_count,
+            .pass = 0,
+        };
+
+        // the push constant ranges differ, so the layouts aren't compatible and the set is bound for each
+        const auto bind {[cmd, this](const Pipeline& pl)
+        {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pl.pipeline);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pl.layout, 0, 1, &set, 0, nullptr);
+        }};
+
+        const auto& count_pl {c.get_compute_pipeline(cull_pipeline)};
+        const auto& scan_pl {c.get_compute_pipeline(scan_pipeline)};
+
+        // visible objects per group
+        bind(count_pl);
+        vkCmdPushConstants(cmd, count_pl.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(data), &data);
+        vkCmdDispatch(cmd, groups_needed, 1, 1);
+        barrier(groups.buffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+        // the first command of each group and the draw count
+        const ScanData scan_data {groups_needed};
+        bind(scan_pl);
+        vkCmdPushConstants(cmd, scan_pl.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(scan_data), &scan_data);
+        vkCmdDispatch(cmd, 1, 1, 1);
+        barrier(groups.buffer, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+        // the commands, at the offsets the scan left
+        data.pass = 1;
+        bind(count_pl);
+        vkCmdPushConstants(cmd, count_pl.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(data), &data);
+        vkCmdDispatch(cmd, groups_needed, 1, 1);
+
+        barrier(commands.buffer, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+        barrier(count.buffer, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+    }
+
+    // inside the render pass
+    void draw()
+    {
+        auto& c {*context};
+        auto cmd {c.command_buffer};
+        const auto& pl {c.get_pipeline(draw_pipeline)};
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pl.pipeline);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pl.layout, 0, 1, &set, 0, nullptr);
+        vkCmdDrawIndirectCount(cmd, commands.buffer, 0, count.buffer, 0, object_count, sizeof(VkDrawIndirectCommand));
+    }
+
+    void destroy()
+    {
+        auto& c {*context};
+        const auto device {c.gpu->device};
+        vkDeviceWaitIdle(device);
+
+        for(auto* b : {&objects, &commands, &count, &groups}){
+            c.destroy_buffer(*b);
+        }
+        vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+        vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+    }
+};
@@ -0,0 +1,17 @@
+#version 450
+
+struct Object
+{
+    vec4 a[3];
+    vec4 b[3];
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Objects { Object objects[]; };
+
+layout(location = 0) out vec4 color;
+
+void main()
+{
+    gl_Position = objects[gl_InstanceIndex].a[gl_VertexIndex];
+    color = objects[gl_InstanceIndex].b[gl_VertexIndex];
+}
@@ -5,12 +5,28 @@
 #include <fstream>
 #include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <random>
+#include <algorithm>
 
 using Time = std::chrono::high_resolution_clock;
 using Duration = std::chrono::duration<float>;
 
 #include "context.hpp"
 #include "types.hpp"
+#include "indirect.hpp"
+#include "spatial_grid.hpp"
+#include "draw_queue.hpp"
+#include "render_graph.hpp"
+#include "benchmark.hpp"
+#include "draw_stream.hpp"
+#include "software_rasterizer.hpp"
+#include "tiled_export.hpp"
+#include "text.hpp"
+#include "vector_shapes.hpp"
+#include "mesh_stream.hpp"
+#include "particles.hpp"
+#include "shader_reload.hpp"
 
 /* TODO
  
@@ -40,14 +56,219 @@ auto matrix_product(const A& a, const B& b)
     return result;
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    auto bench_indirect {false};
+    auto grid_stats {false};
+    auto queue_stats {false};
+    auto depth {false};
+    auto overdraw_stats {false};
+    auto use_graph {false};
+    auto graph_dump {false};
+    u32 grid_shapes {0};
+    u32 benchmark_frames {0};
+    u32 benchmark_warmup {60};
+    String benchmark_json;
+    String capture_path;
+    String replay_path;
+    u32 replay_loops {2};
+    auto software {false};
+    auto software_compare {false};
+    u32 software_threads {0};
+    u32 tolerance {2};
+    String software_out;
+    String export_path;
+    u32 export_width {16384};
+    u32 text_labels {0};
+    auto text_stats {false};
+    u32 vector_shapes {0};
+    auto shape_stats {false};
+    auto tessellation_bench {false};
+    auto descriptor_bench {false};
+    String mesh_path;
+    u32 mesh_budget {8};
+    auto memory_stats {false};
+    u32 clip_panels {0};
+    auto clip_scissor_only {false};
+    float memory_budget {0.9f};
+    u32 particles {0};
+    auto particle_stats {false};
+    auto particle_bench {false};
+    auto watch_shaders {false};
+    String shader_dir {"."};
+    String shader_compiler;
+    for(int i = 1; i < argc; i++)
+    {
+        const String arg {argv[i]};
+        if(arg == "--bench-indirect"){
+            bench_indirect = true;
+        }
+        else if(arg == "--grid-stats"){
+            grid_stats = true;
+        }
+        else if(arg == "--queue-stats"){
+            queue_stats = true;
+        }
+        else if(arg == "--depth"){
+            depth = true;
+        }
+        else if(arg == "--overdraw-stats"){
+            overdraw_stats = true;
+        }
+        else if(arg == "--render-graph"){
+            use_graph = true;
+        }
+        else if(arg == "--graph-dump"){
+            use_graph = true;
+            graph_dump = true;
+        }
+        else if(arg == "--grid-shapes" && i + 1 < argc){
+            grid_shapes = std::stoul(argv[++i]);
+        }
+        else if(arg == "--benchmark" && i + 1 < argc){
+            benchmark_frames = std::stoul(argv[++i]);
+        }
+        else if(arg == "--warmup" && i + 1 < argc){
+            benchmark_warmup = std::stoul(argv[++i]);
+        }
+        else if(arg == "--json" && i + 1 < argc){
+            benchmark_json = argv[++i];
+        }
+        else if(arg == "--capture" && i + 1 < argc){
+            capture_path = argv[++i];
+        }
+        else if(arg == "--replay" && i + 1 < argc){
+            replay_path = argv[++i];
+        }
+        else if(arg == "--loops" && i + 1 < argc){
+            replay_loops = std::stoul(argv[++i]);
+        }
+        else if(arg == "--software"){
+            software = true;
+        }
+        else if(arg == "--software-compare"){
+            software_compare = true;
+        }
+        else if(arg == "--threads" && i + 1 < argc){
+            software_threads = std::stoul(argv[++i]);
+        }
+        else if(arg == "--tolerance" && i + 1 < argc){
+            tolerance = std::stoul(argv[++i]);
+        }
+        else if(arg == "--software-out" && i + 1 < argc){
+            software_out = argv[++i];
+        }
+        else if(arg == "--export" && i + 1 < argc){
+            export_path = argv[++i];
+        }
+        else if(arg == "--export-width" && i + 1 < argc){
+            export_width = std::stoul(argv[++i]);
+        }
+        else if(arg == "--text" && i + 1 < argc){
+            text_labels = std::stoul(argv[++i]);
+        }
+        else if(arg == "--text-stats"){
+            text_stats = true;
+        }
+        else if(arg == "--vector-shapes" && i + 1 < argc){
+            vector_shapes = std::stoul(argv[++i]);
+        }
+        else if(arg == "--shape-stats"){
+            shape_stats = true;
+        }
+        else if(arg == "--tessellation-bench"){
+            tessellation_bench = true;
+        }
+        else if(arg == "--descriptor-bench"){
+            descriptor_bench = true;
+        }
+        else if(arg == "--mesh" && i + 1 < argc){
+            mesh_path = argv[++i];
+        }
+        else if(arg == "--mesh-budget" && i + 1 < argc){
+            mesh_budget = std::stoul(argv[++i]);
+        }
+        else if(arg == "--memory-stats"){
+            memory_stats = true;
+        }
+        else if(arg == "--clip-panels" && i + 1 < argc){
+            clip_panels = std::stoul(argv[++i]);
+        }
+        else if(arg == "--clip-scissor-only"){
+            clip_scissor_only = true;
+        }
+        else if(arg == "--memory-budget" && i + 1 < argc){
+            memory_budget = std::stof(argv[++i]);
+        }
+        else if(arg == "--particles" && i + 1 < argc){
+            particles = std::stoul(argv[++i]);
+        }
+        else if(arg == "--particle-stats"){
+            particle_stats = true;
+        }
+        else if(arg == "--particle-bench"){
+            particle_bench = true;
+        }
+        else if(arg == "--watch-shaders"){
+            watch_shaders = true;
+        }
+        else if(arg == "--shader-dir" && i + 1 < argc){
+            shader_dir = argv[++i];
+        }
+        else if(arg == "--shader-compiler" && i + 1 < argc){
+            shader_compiler = argv[++i];
+        }
+        else if(arg == "--headless"){
+            // same as running with SDL_VIDEODRIVER=dummy
+            SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+        }
+    }
+
     Context context;
-    context.init("vulkan test", 1280, 720);
-    context.build_synchronization();
-    context.build_pipeline_stages();
+    context.depth_enabled = depth;
+    context.memory.warn_fraction = memory_budget;
+    if(benchmark_frames || !replay_path.empty()){
+        context.present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    }
+    context.read_back_enabled = software_compare;
+    context.backbuffer_transfer_dst = use_graph;
 
-    auto immediate_pipeline {context.add_new_pipeline([&]() -> Pipeline
+    // the software backend needs no device, pipelines are only ids for the draw queue
+    if(software)
+    {
+        context.width = 1280;
+        context.height = 720;
+        context.extent = {1280, 720};
+        context.scissor = {{0, 0}, context.extent};
+        context.view = {{0.f, 0.f}, {1280.f, 720.f}};
+    }
+    else
+    {
+        context.init("vulkan test", 1280, 720);
+        context.build_synchronization();
+        context.build_pipeline_stages();
+
+        // the graph blits its result into the backbuffer
+        if(use_graph && !(context.swapchain_usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+        {
+            fprintf(stderr, "--graph needs swapchain images usable as transfer destinations, this surface has none\n");
+            return 1;
+        }
+
+        // the comparison copies the presented image back
+        if(software_compare && !(context.swapchain_usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+        {
+            fprintf(stderr, "--software-compare needs swapchain images usable as transfer sources, this surface has none\n");
+            return 1;
+        }
+    }
+
+    auto add_pipeline {[&](auto f)
+    {
+        return software ? context.add_new_pipeline([]{ return Pipeline{}; }) : context.add_new_pipeline(f);
+    }};
+
+    auto immediate_pipeline {add_pipeline([&]() -> Pipeline
     {
         struct Data
         {
@@ -69,7 +290,7 @@ int main()
         VkPipelineShaderStageCreateInfo shader_stages[shader_count] {};
 
         shader_stages[0] = c.new_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vertex);
-        shader_stages[1] = c.new_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, context.generic_fragment_shader);
+        shader_stages[1] = c.new_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, c.use_generic_fragment());
         info.pStages = shader_stages;
 
         VkPushConstantRange constant
@@ -96,7 +317,7 @@ int main()
         return result;
     })};
 
-    auto additive_pipeline {context.add_new_pipeline([&]() -> Pipeline
+    auto additive_pipeline {add_pipeline([&]() -> Pipeline
     {
         struct Data
         {
@@ -127,6 +348,11 @@ int main()
         color_blend_info.pAttachments = &color_blend_attachment;
         info.pColorBlendState = &color_blend_info;
 
+        // tested against the opaque pass but never occludes anything itself
+        if(c.depth_enabled){
+            info.pDepthStencilState = &c.blend_depth_stencil_info;
+        }
+
         auto vertex {c.load_shader("ishader.vert.spv")};
 
         const auto shader_count {2};
@@ -136,7 +362,7 @@ int main()
         VkPipelineShaderStageCreateInfo shader_stages[shader_count] {};
 
         shader_stages[0] = c.new_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vertex);
-        shader_stages[1] = c.new_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, context.generic_fragment_shader);
+        shader_stages[1] = c.new_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, c.use_generic_fragment());
         info.pStages = shader_stages;
 
         VkPushConstantRange constant
@@ -180,17 +406,52 @@ int main()
         return a;
     }};
 
-    auto render_triangle {[&](const int p, V2 a, V2 b, V2 c, const RGBA& ca, const RGBA& cb, const RGBA& cc, const float rotation = 0.f, V2 mid = {FLT_MAX, FLT_MAX})
+    // layer 0 is opaque and gets sorted by pipeline, additive draws go on a translucent layer
+    constexpr u8 opaque_layer {0};
+    constexpr u8 additive_layer {1};
+    constexpr u8 ui_layer {2};
+
+    DrawQueue queue;
+    queue.set_translucent(additive_layer);
+    queue.set_translucent(ui_layer);
+    queue.trim_vertices = clip_scissor_only ? 0 : queue.trim_vertices;
+    queue.painter_depth = context.depth_enabled;
+
+    DrawStream stream;
+    if(!capture_path.empty() && !stream.open(capture_path.c_str(), context.width, context.height, context.pipelines.size())){
+        fprintf(stderr, "could not open %s for capture\n", capture_path.c_str());
+    }
+
+    auto write_benchmark {[&](Benchmark& benchmark, const char* scene)
     {
-        const auto& pl {context.get_pipeline(p)};
+        vkDeviceWaitIdle(context.gpu->device);
 
-        struct Data
+        // --json - puts the json alone on stdout and the table on stderr, so either parses
+        const auto json_stdout {benchmark_json == "-"};
+        const auto table {json_stdout ? stderr : stdout};
+        benchmark.print(table);
+        fprintf(table, "memory %s, peak %.1f MB\n", context.memory.summary().c_str(), context.memory.peak / 1e6);
+
+        if(benchmark_json.empty()){
+            return;
+        }
+
+        const auto json {benchmark.json(context, scene)};
+        if(json_stdout){
+            printf("%s", json.c_str());
+        }
+        else
         {
-            V4 a[3];
-            RGBA b[3];
-        };
+            std::ofstream f {benchmark_json};
+            f << json;
+        }
+    }};
 
-        constexpr auto size {sizeof(Data)};
+    auto render_triangle {[&](const int p, V2 a, V2 b, V2 c, const RGBA& ca, const RGBA& cb, const RGBA& cc, const float rotation = 0.f, V2 mid = {FLT_MAX, FLT_MAX})
+    {
+        if(stream.capturing()){
+            stream.add(p, queue.layer, a, b, c, ca, cb, cc, rotation, mid);
+        }
 
         const auto sin {sinf(rotation)};
         const auto cos {cosf(rotation)};
@@ -250,11 +511,7 @@ int main()
                        cc.r, cc.g, cc.b, cc.a 
         };
 
-        vkCmdBindPipeline(context.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pl.pipeline);
-
-        vkCmdPushConstants(context.command_buffer, pl.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, size, (void*)(data));
-
-        vkCmdDraw(context.command_buffer, 3, 1, 0, 0);
+        queue.push(p, data);
     }};
 
     auto i_render_triangle {[&](const int p, V2 a, V2 b, V2 c, RGBA color, const float rotation = 0.f, V2 mid = {FLT_MAX, FLT_MAX})
@@ -271,20 +528,1007 @@ int main()
         i_render_triangle(p, {a.x + b.x, a.y}, {a.x, a.y + b.y}, {a.x + b.x, a.y + b.y}, c, rotation, mid);
     }};
 
+    // sweeps object counts over a world 3x the size of the window and compares
+    // cpu record time of one vkCmdDraw per object against the culled indirect path
+    if(bench_indirect && (software || !(context.gpu->draw_indirect_count && context.gpu->draw_indirect_first_instance)))
+    {
+        fprintf(stderr, "--bench-indirect needs drawIndirectCount and drawIndirectFirstInstance\n");
+        return 1;
+    }
+    if(bench_indirect)
+    {
+        constexpr u32 counts[] {1000, 10000, 100000, 1000000};
+        constexpr u32 immediate_limit {100000};
+        constexpr auto frames {100};
+        constexpr auto warmup {10};
+
+        IndirectScene scene;
+        scene.init(context, counts[array_size(counts) - 1]);
+
+        struct Triangle
+        {
+            V2 a;
+            V2 b;
+            V2 c;
+            RGBA color;
+        };
+
+        std::mt19937 rng {1234};
+        std::uniform_real_distribution<float> world_x {-(float)context.width, context.width * 2.f};
+        std::uniform_real_distribution<float> world_y {-(float)context.height, context.height * 2.f};
+        std::uniform_real_distribution<float> offset {-40.f, 40.f};
+        std::uniform_real_distribution<float> unit {0.f, 1.f};
+
+        Array<Triangle> triangles(counts[array_size(counts) - 1]);
+        Array<IndirectObject> objects(triangles.size());
+
+        for(u32 i = 0; i < triangles.size(); i++)
+        {
+            auto& t {triangles[i]};
+            V2 p {world_x(rng), world_y(rng)};
+            t.a = {p.x + offset(rng), p.y + offset(rng)};
+            t.b = {p.x + offset(rng), p.y + offset(rng)};
+            t.c = {p.x + offset(rng), p.y + offset(rng)};
+            t.color = {unit(rng), unit(rng), unit(rng), 1.f};
+
+            auto& o {objects[i]};
+            const V2 v[3] {context.norm(t.a.x, t.a.y), context.norm(t.b.x, t.b.y), context.norm(t.c.x, t.c.y)};
+            for(int j = 0; j < 3; j++)
+            {
+                o.a[j] = {v[j].x, v[j].y, 0.f, 1.f};
+                o.b[j] = t.color;
+            }
+        }
+
+        printf("%10s %16s %16s\n", "objects", "immediate ms", "indirect ms");
+
+        for(auto n : counts)
+        {
+            vkDeviceWaitIdle(context.gpu->device);
+            scene.set_objects(objects.data(), n);
+
+            float immediate {-1.f};
+            if(n <= immediate_limit)
+            {
+                float total {};
+                for(int f = 0; f < warmup + frames; f++)
+                {
+                    context.render_reset(clear);
+                    const auto t0 {Time::now()};
+                    for(u32 i = 0; i < n; i++)
+                    {
+                        const auto& t {triangles[i]};
+                        i_render_triangle(immediate_pipeline, t.a, t.b, t.c, t.color);
+                    }
+                    queue.flush(context);
+                    const auto t1 {Time::now()};
+                    context.present();
+                    if(f >= warmup){
+                        total += Duration{t1 - t0}.count();
+                    }
+                }
+                immediate = total / frames * 1000.f;
+            }
+
+            float indirect {};
+            for(int f = 0; f < warmup + frames; f++)
+            {
+                context.begin_frame();
+                const auto t0 {Time::now()};
+                scene.cull();
+                context.begin_render_pass(clear);
+                scene.draw();
+                const auto t1 {Time::now()};
+                context.present();
+                if(f >= warmup){
+                    indirect += Duration{t1 - t0}.count();
+                }
+            }
+            indirect = indirect / frames * 1000.f;
+
+            if(immediate < 0.f){
+                printf("%10u %16s %16.3f\n", n, "-", indirect);
+            }
+            else{
+                printf("%10u %16.3f %16.3f\n", n, immediate, indirect);
+            }
+        }
+        scene.destroy();
+        return 0;
+    }
+
+    // plays a captured stream back as fast as presentation allows, the first loop warms up
+    if(!replay_path.empty())
+    {
+        DrawStream replay;
+        if(!replay.load(replay_path.c_str(), context.pipelines.size()) || replay.frames.empty())
+        {
+            fprintf(stderr, "could not load %s\n", replay_path.c_str());
+            return 1;
+        }
+        if(replay.width != context.width || replay.height != context.height){
+            fprintf(stderr, "%s was captured at %ux%u\n", replay_path.c_str(), replay.width, replay.height);
+        }
+        // the ids may still be in range but point at other pipelines
+        if(replay.pipelines != context.pipelines.size())
+        {
+            fprintf(stderr, "%s was captured with %u pipelines, this run has %u, replay with the same flags\n",
+                    replay_path.c_str(), replay.pipelines, (u32)context.pipelines.size());
+        }
+
+        const u32 count = replay.frames.size();
+        const auto loops {std::max(replay_loops, 1u)};
+
+        Benchmark benchmark;
+        benchmark.init(loops > 1 ? count : 0, count * (loops > 1 ? loops - 1 : 1));
+
+        auto previous {Time::now()};
+        for(u32 i = 0; !benchmark.done(); i++)
+        {
+            const auto now {Time::now()};
+            if(i > 0){
+                benchmark.add(context.timings, std::chrono::duration<float, std::milli>{now - previous}.count());
+            }
+            previous = now;
+
+            SDL_Event e;
+            while(SDL_PollEvent(&e)){}
+
+            const auto& f {replay.frames[i % count]};
+            context.render_reset(f.clear);
+            for(u32 j = 0; j < f.count; j++)
+            {
+                const auto& t {replay.triangles[f.first + j]};
+                queue.layer = t.layer;
+                render_triangle(t.pipeline, t.a, t.b, t.c, t.colors[0], t.colors[1], t.colors[2], t.rotation, t.mid);
+            }
+            queue.flush(context);
+            context.present();
+        }
+
+        write_benchmark(benchmark, replay_path.c_str());
+        return 0;
+    }
+
+    // retained shapes, everything drawn in the main loop goes through the grid
+    struct Shape
+    {
+        u32 pipeline;
+        V2 a;
+        V2 b; // size for rectangles
+        V2 c;
+        RGBA colors[3];
+        u8 layer {0};
+        bool rectangle {false};
+        bool rotates {false};
+    };
+
+    Array<Shape> shapes;
+    SpatialGrid grid;
+    grid.init(256.f);
+
+    // rotating shapes get the circle around their pivot so spinning never moves them in the grid
+    auto shape_bounds {[](const Shape& s) -> Rect
+    {
+        if(s.rectangle && !s.rotates){
+            return {s.a, {s.a.x + s.b.x, s.a.y + s.b.y}};
+        }
+
+        V2 mid;
+        Array<V2> points;
+        if(s.rectangle)
+        {
+            mid = {s.a.x + s.b.x * 0.5f, s.a.y + s.b.y * 0.5f};
+            points = {s.a, {s.a.x + s.b.x, s.a.y + s.b.y}};
+        }
+        else
+        {
+            mid = {(s.a.x + s.b.x + s.c.x) / 3.f, (s.a.y + s.b.y + s.c.y) / 3.f};
+            points = {s.a, s.b, s.c};
+        }
+
+        float radius {0.f};
+        for(auto& p : points){
+            radius = fmaxf(radius, hypotf(p.x - mid.x, p.y - mid.y));
+        }
+        return {{mid.x - radius, mid.y - radius}, {mid.x + radius, mid.y + radius}};
+    }};
+
+    auto add_shape {[&](const Shape& s) -> u32
+    {
+        const auto id {grid.insert(shape_bounds(s))};
+        assert(id == shapes.size());
+        shapes.push_back(s);
+        return id;
+    }};
+
+    auto add_triangle {[&](const int p, V2 a, V2 b, V2 c, const RGBA& ca, const RGBA& cb, const RGBA& cc)
+    {
+        return add_shape({.pipeline = (u32)p, .a = a, .b = b, .c = c, .colors = {ca, cb, cc}, .layer = opaque_layer, .rotates = true});
+    }};
+
+    auto add_rectangle {[&](const int p, V2 a, V2 b, const RGBA& c, const u8 layer)
+    {
+        return add_shape({.pipeline = (u32)p, .a = a, .b = b, .colors = {c, c, c}, .layer = layer, .rectangle = true});
+    }};
+
+    add_triangle(immediate_pipeline, {500, 0}, {10, 100}, { 510, 80}, {1.f, 1.f, 1.f, 1.f}, {1.f, 1.f, 1.f, 1.f}, {1.f, 1.f, 1.f, 1.f});
+    add_triangle(immediate_pipeline, {500,  300}, {400, 450}, {575, 400}, {1.f, 0.f, 1.f, 1.f}, {0, 1.f, 1.f, 1.f}, {1.f, 1.f, 0, 1.f});
+    add_triangle(immediate_pipeline, {510,  300}, {600, 600}, {550, 400}, {0, 0.f, 1.f, 1.f}, {0, 0.f, 1.f, 1.f}, {0, 0.f, 1.f, 1.f});
+    add_triangle(immediate_pipeline, {550,  300}, {650, 600}, {580, 350}, {1, 0.f, 0.f, 1.f}, {1, 0.f, 0.f, 1.f}, {1, 0.f, 0.f, 1.f});
+
+    {
+        // filler spread over a world 20x the window, only a small part is ever visible
+        std::mt19937 rng {4321};
+        std::uniform_real_distribution<float> world_x {-context.width * 10.f, context.width * 10.f};
+        std::uniform_real_distribution<float> world_y {-context.height * 10.f, context.height * 10.f};
+        std::uniform_real_distribution<float> extent {4.f, 64.f};
+        std::uniform_real_distribution<float> unit {0.f, 1.f};
+        for(u32 i = 0; i < grid_shapes; i++){
+            add_rectangle(immediate_pipeline, {world_x(rng), world_y(rng)}, {extent(rng), extent(rng)}, {unit(rng), unit(rng), unit(rng), 1.f}, opaque_layer);
+        }
+    }
+
+    V2 cursor_size {720, 720};
+    const auto cursor_shape {add_rectangle(additive_pipeline, {-cursor_size.x, -cursor_size.y}, cursor_size, {0, 1, 0, 1.f}, additive_layer)};
+
+    Array<u32> visible;
+    float angle {0.f};
+
+    auto cull_scene {[&]()
+    {
+        grid.query(context.view, visible);
+
+        // keep submission order so translucent layers blend the same as before culling
+        std::sort(visible.begin(), visible.end());
+    }};
+
+    auto update_scene {[&]()
+    {
+        {
+            auto& s {shapes[cursor_shape]};
+            s.a = {mouse.x - cursor_size.x * 0.5f, mouse.y - cursor_size.y * 0.5f};
+            grid.move(cursor_shape, shape_bounds(s));
+        }
+
+        cull_scene();
+    }};
+
+    // window pixels
+    auto push_clip {[&](const V2 a, const V2 b)
+    {
+        queue.push_clip({context.norm(a.x, a.y), context.norm(b.x, b.y)});
+    }};
+
+    // editor style panels: a scrolling list with a nested, sideways scrolling strip in each,
+    // every row clipped by its strip, its panel and the window
+    auto queue_panels {[&]()
+    {
+        const auto columns {(u32)ceilf(sqrtf((float)clip_panels))};
+        const auto rows {(clip_panels + columns - 1) / columns};
+        const V2 size {(float)context.width / columns, (float)context.height / rows};
+        constexpr float row_height {18.f};
+        const auto scroll {angle * 120.f};
+
+        queue.layer = ui_layer;
+        for(u32 i = 0; i < clip_panels; i++)
+        {
+            const V2 p {(i % columns) * size.x, (i / columns) * size.y};
+            const V2 inner {p.x + 6.f, p.y + 6.f};
+            const V2 inner_size {size.x - 12.f, size.y - 12.f};
+
+            render_rectangle(immediate_pipeline, p, size, {0.15f, 0.15f, 0.18f, 1.f});
+
+            push_clip(inner, {inner.x + inner_size.x, inner.y + inner_size.y});
+            const auto offset {fmodf(scroll + i * 7.f, row_height * 2.f)};
+            for(auto y = inner.y - offset; y < inner.y + inner_size.y; y += row_height)
+            {
+                const auto shade {0.3f + 0.2f * fmodf(y / row_height, 2.f)};
+                render_rectangle(immediate_pipeline, {inner.x - 4.f, y}, {inner_size.x + 8.f, row_height - 2.f}, {shade, shade, shade + 0.1f, 1.f});
+            }
+
+            const V2 strip {inner.x + inner_size.x * 0.25f, inner.y + inner_size.y * 0.4f};
+            const V2 strip_size {inner_size.x * 0.5f, inner_size.y * 0.3f};
+            push_clip(strip, {strip.x + strip_size.x, strip.y + strip_size.y});
+            render_rectangle(immediate_pipeline, strip, strip_size, {0.1f, 0.2f, 0.3f, 1.f});
+            for(auto x = strip.x - fmodf(scroll, 40.f); x < strip.x + strip_size.x; x += 40.f){
+                render_rectangle(immediate_pipeline, {x, strip.y + 4.f}, {32.f, strip_size.y - 8.f}, {0.9f, 0.6f, 0.2f, 1.f});
+            }
+
+            // rotated, so clipping it usually leaves too many corners to trim
+            const V2 c {strip.x + strip_size.x * 0.5f, strip.y + strip_size.y * 0.5f};
+            const auto r {strip_size.y};
+            i_render_triangle(immediate_pipeline, {c.x - r, c.y + r}, {c.x + r, c.y + r}, {c.x, c.y - r}, {0.8f, 0.2f, 0.4f, 1.f}, angle * 2.f, c);
+
+            queue.pop_clip();
+            queue.pop_clip();
+        }
+    }};
+
+    auto queue_scene {[&]()
+    {
+        for(auto id : visible)
+        {
+            const auto& s {shapes[id]};
+            const auto rotation {s.rotates ? angle : 0.f};
+            queue.layer = s.layer;
+            if(s.rectangle){
+                render_rectangle(s.pipeline, s.a, s.b, s.colors[0], rotation);
+            }
+            else{
+                render_triangle(s.pipeline, s.a, s.b, s.c, s.colors[0], s.colors[1], s.colors[2], rotation);
+            }
+        }
+
+        if(clip_panels){
+            queue_panels();
+        }
+    }};
+
+    auto draw_scene {[&]()
+    {
+        queue_scene();
+        queue.flush(context);
+    }};
+
+    auto script_mouse {[&](const u64 frame)
+    {
+        const auto t {frame * (1.f / 60.f)};
+        mouse.x = context.width * (0.5f + 0.4f * cosf(t));
+        mouse.y = context.height * (0.5f + 0.4f * sinf(t * 2.f));
+    }};
+
+    SoftwareRasterizer raster;
+    if(software || software_compare)
+    {
+        raster.depth_enabled = context.depth_enabled;
+        raster.pipeline_blend.resize(context.pipelines.size(), SoftwareRasterizer::alpha);
+        raster.pipeline_blend[additive_pipeline] = SoftwareRasterizer::additive;
+    }
+
+    // cpu only: sweeps thread counts over the animated scene, --threads pins one count
+    if(software)
+    {
+        Array<u32> counts;
+        if(software_threads){
+            counts = {software_threads};
+        }
+        else
+        {
+            const auto hardware {std::max(std::thread::hardware_concurrency(), 1u)};
+            for(u32 n = 1; n < hardware; n *= 2){
+                counts.push_back(n);
+            }
+            counts.push_back(hardware);
+        }
+
+        const u32 frames {benchmark_frames ? benchmark_frames : 100};
+        constexpr u32 warmup {10};
+
+        // no workers yet, set_threads starts them for each count
+        raster.init(context.width, context.height, 1);
+
+        printf("%8s %12s %12s %14s\n", "threads", "ms/frame", "Mpixels/s", "Mtriangles/s");
+        for(auto n : counts)
+        {
+            raster.set_threads(n);
+
+            double seconds {0.0};
+            u64 pixels {0};
+            u64 triangles {0};
+            for(u32 f = 0; f < warmup + frames; f++)
+            {
+                script_mouse(f);
+                angle = fmodf(f * (M_PI / 60.f) * 0.25f, M_PI * 2.f);
+                update_scene();
+
+                const auto t0 {Time::now()};
+                raster.clear(clear);
+                queue_scene();
+                raster.draw(queue);
+                raster.finish();
+                const auto t1 {Time::now()};
+
+                if(f >= warmup)
+                {
+                    seconds += Duration{t1 - t0}.count();
+                    pixels += raster.stats.fragments;
+                    triangles += raster.stats.triangles;
+                }
+            }
+
+            printf("%8u %12.3f %12.1f %14.3f\n", n, seconds / frames * 1000.0, pixels / seconds / 1e6, triangles / seconds / 1e6);
+        }
+
+        if(!software_out.empty()){
+            raster.save_ppm(software_out.c_str());
+        }
+        return 0;
+    }
+
+    // renders one scripted frame on the device and on the cpu and compares them
+    if(software_compare)
+    {
+        raster.init(context.width, context.height, software_threads ? software_threads : std::max(std::thread::hardware_concurrency(), 1u));
+
+        script_mouse(0);
+        angle = 0.5f;
+        update_scene();
+
+        context.render_reset(clear);
+        raster.clear(clear);
+        queue_scene();
+
+        auto copy {queue};
+        raster.draw(copy);
+        raster.finish();
+
+        queue.flush(context);
+        context.request_read_back();
+        context.present();
+
+        Array<u32> gpu_pixels;
+        context.read_back(gpu_pixels);
+
+        u32 worst {0};
+        u64 over {0};
+        for(size_t i = 0; i < gpu_pixels.size() && i < raster.pixels.size(); i++)
+        {
+            // alpha is left out, the swapchain may not keep it
+            u32 diff {0};
+            for(int c = 0; c < 3; c++){
+                diff = std::max(diff, (u32)abs((int)((gpu_pixels[i] >> (c * 8)) & 0xff) - (int)((raster.pixels[i] >> (c * 8)) & 0xff)));
+            }
+            worst = std::max(worst, diff);
+            over += diff > tolerance;
+        }
+
+        printf("max channel difference %u, %llu of %zu pixels over %u\n", worst, (unsigned long long)over, gpu_pixels.size(), tolerance);
+        if(!software_out.empty()){
+            raster.save_ppm(software_out.c_str());
+        }
+
+        vkDeviceWaitIdle(context.gpu->device);
+        // a few edge pixels may round differently, more than 0.1% means the backends disagree
+        return over * 1000 > gpu_pixels.size() ? 1 : 0;
+    }
+
+    // poster sized export, the window's scene scaled up to export_width and rendered in tiles
+    if(!export_path.empty())
+    {
+        const u32 export_height = (u64)export_width * context.height / context.width;
+
+        // the first scripted frame, the same update the window runs before drawing. the tiles
+        // only cull again for their own view, so they all see the one scene
+        script_mouse(0);
+        update_scene();
+
+        TiledExport exporter;
+        exporter.init(context);
+
+        const auto ok {exporter.run(export_path.c_str(), export_width, export_height, clear, [&](VkCommandBuffer cmd)
+        {
+            cull_scene();
+            queue_scene();
+            queue.flush(context, cmd);
+        })};
+
+        if(!ok)
+        {
+            fprintf(stderr, "could not open %s\n", export_path.c_str());
+            return 1;
+        }
+
+        const auto& st {exporter.stats};
+        printf("exported %ux%u in %u tiles of %ux%u: %.3f s, %.1f tiles/s, %.1f MB written, %zu tiles in flight\n",
+               export_width, export_height, st.tiles, context.extent.width, context.extent.height,
+               st.seconds, st.tiles / st.seconds, st.bytes / 1e6, exporter.slots.size());
+
+        exporter.destroy();
+        return 0;
+    }
+
+    // dashboard style labels: a fixed name and a value that changes at a per label rate,
+    // so some layouts are reused for many frames and some are rebuilt often
+    TextRenderer text;
+    float text_ms {0.f};
+    if(text_labels){
+        text.init(context);
+    }
+
+    auto build_labels {[&](const u64 frame)
+    {
+        constexpr float size {7.f};
+        constexpr float column_width {150.f};
+        const auto rows {std::max((u32)((context.height - 8) / (size * 2.f)), 1u)};
+
+        char label[64];
+        for(u32 i = 0; i < text_labels; i++)
+        {
+            const auto period {1 + i % 60};
+            const u32 value = (frame / period + i * 37) % 1000;
+            snprintf(label, sizeof(label), "sensor %u: %u.%u%%", i, value / 10, value % 10);
+
+            const V2 p {4.f + (i / rows) * column_width, 4.f + (i % rows) * size * 2.f};
+            text.add(label, p, size, {1.f, 1.f, 1.f, 1.f});
+        }
+    }};
+
+    VectorShapes shapes_2d;
+    float shapes_ms {0.f};
+    if(vector_shapes || tessellation_bench){
+        shapes_2d.init(context);
+    }
+
+    // a field of orbiting circles, with rings, arcs, rounded rectangles and a few lines.
+    // the wave changes every frame so its tessellation is always a cache miss
+    auto build_shapes {[&](const u64 frame)
+    {
+        const auto t {frame / 60.f};
+        std::mt19937 rng {99};
+        std::uniform_real_distribution<float> unit {0.f, 1.f};
+
+        for(u32 i = 0; i < vector_shapes; i++)
+        {
+            const V2 home {unit(rng) * context.width, unit(rng) * context.height};
+            const auto radius {2.f + 30.f * powf(unit(rng), 4.f)};
+            const auto phase {unit(rng) * 6.28f};
+            const V2 p {home.x + cosf(t + phase) * 20.f, home.y + sinf(t + phase) * 20.f};
+            const RGBA color {unit(rng), unit(rng), unit(rng), 0.8f};
+
+            switch(i % 8)
+            {
+                case 0: shapes_2d.ring(p, radius, fmaxf(radius * 0.25f, 1.f), color); break;
+                case 1: shapes_2d.arc(p, radius, 0.6f, t + phase, 4.f, color); break;
+                case 2: shapes_2d.rounded_rectangle({p.x - radius, p.y - radius * 0.5f}, {radius * 2.f, radius}, radius * 0.3f, color); break;
+                default: shapes_2d.circle(p, radius, color); break;
+            }
+        }
+
+        V2 star[10];
+        for(int i = 0; i < 10; i++)
+        {
+            const auto a {i * (float)M_PI / 5.f};
+            const auto r {i % 2 ? 40.f : 100.f};
+            star[i] = {context.width * 0.5f + cosf(a) * r, context.height * 0.5f + sinf(a) * r};
+        }
+        shapes_2d.polyline(star, 10, 6.f, {1.f, 0.8f, 0.2f, 1.f}, VectorShapes::miter, true);
+
+        V2 wave[64];
+        for(int i = 0; i < 64; i++){
+            wave[i] = {40.f + i * 18.f, context.height * 0.8f + sinf(t * 3.f + i * 0.3f) * 40.f};
+        }
+        shapes_2d.polyline(wave, 64, 4.f, {0.2f, 0.8f, 1.f, 1.f}, VectorShapes::round);
+    }};
+
+    // streamed from the mapping over the first frames, drawn from the first resident chunk on
+    MeshStreamer mesh;
+    const auto meshes {!mesh_path.empty()};
+    if(meshes && !mesh.init(context, mesh_path.c_str(), (u64)mesh_budget << 20))
+    {
+        fprintf(stderr, "could not load %s\n", mesh_path.c_str());
+        return 1;
+    }
+
+    // simulated and drawn on the gpu, the cpu only records the same few commands every frame
+    ParticleSystem particle_system;
+    constexpr auto particle_life {2.f}; // mean of particle_emit.comp
+    if(particles){
+        particle_system.init(context, particles);
+    }
+
+    // gpu time of spawn, simulation and compaction at a steady population
+    if(particle_bench)
+    {
+        constexpr u32 warmup {180}; // longer than the longest life, so the population has settled
+        constexpr u32 frames {300};
+        constexpr float step {1.f / 60.f};
+
+        printf("%10s %10s %12s %20s\n", "capacity", "alive", "gpu ms", "particles per ms");
+        for(u32 n = 1 << 14; n <= 1 << 20; n <<= 2)
+        {
+            ParticleSystem ps;
+            ps.init(context, n);
+            const auto spawn {(u32)(n * step / particle_life)};
+
+            float gpu {};
+            u32 timed {0};
+            for(u32 f = 0; f < warmup + frames; f++)
+            {
+                context.begin_frame();
+                ps.update(context.command_buffer, step, {context.width * 0.5f, context.height * 0.9f}, spawn);
+                context.begin_render_pass(clear);
+                ps.draw(context.command_buffer);
+                context.present();
+
+                if(f >= warmup && ps.stats.timed)
+                {
+                    gpu += ps.stats.gpu_ms;
+                    timed++;
+                }
+            }
+
+            vkDeviceWaitIdle(context.gpu->device);
+            if(timed)
+            {
+                gpu /= timed;
+                printf("%10u %10u %12.3f %20.0f\n", n, ps.stats.alive, gpu, ps.stats.alive / gpu);
+            }
+            else{
+                printf("%10u %10u %12s %20s\n", n, ps.stats.alive, "-", "-");
+            }
+            ps.destroy();
+        }
+        return 0;
+    }
+
+    // cpu cost of the cached paths against tessellating every shape every frame
+    if(tessellation_bench)
+    {
+        constexpr u32 circles {50000};
+        constexpr u32 lines {200};
+        constexpr u32 points {64};
+        constexpr u32 iterations {20};
+
+        std::mt19937 rng {5};
+        std::uniform_real_distribution<float> unit {0.f, 1.f};
+
+        Array<V2> centers(circles);
+        Array<float> radii(circles);
+        for(u32 i = 0; i < circles; i++)
+        {
+            centers[i] = {unit(rng) * context.width, unit(rng) * context.height};
+            radii[i] = 2.f + 60.f * powf(unit(rng), 3.f);
+        }
+
+        Array<Array<V2>> polylines(lines, Array<V2>(points));
+        for(auto& l : polylines)
+        {
+            for(auto& p : l){
+                p = {unit(rng) * context.width, unit(rng) * context.height};
+            }
+        }
+
+        auto seconds {[](auto f)
+        {
+            const auto t0 {Time::now()};
+            for(u32 i = 0; i < iterations; i++){
+                f();
+            }
+            return Duration{Time::now() - t0}.count() / iterations;
+        }};
+
+        // the instanced paths only pay off once they are drawn, so their timing runs inside
+        // a frame and includes recording the draws, presenting is left out
+        auto frame_seconds {[&](auto f)
+        {
+            float total {0.f};
+            for(u32 i = 0; i < iterations; i++)
+            {
+                context.begin_frame();
+                context.begin_render_pass(clear);
+                const auto t0 {Time::now()};
+                shapes_2d.begin_frame();
+                f();
+                shapes_2d.draw(context.command_buffer);
+                total += Duration{Time::now() - t0}.count();
+                context.present();
+            }
+            return total / iterations;
+        }};
+
+        u64 fan_vertices {0};
+        Array<V2> fan;
+        const auto immediate_circles {seconds([&]
+        {
+            fan_vertices = 0;
+            for(u32 i = 0; i < circles; i++)
+            {
+                const auto n {(u32)ceilf(VectorShapes::segments_for(radii[i]))};
+                fan.clear();
+                for(u32 s = 0; s < n; s++)
+                {
+                    const auto a0 {s * 2.f * (float)M_PI / n};
+                    const auto a1 {(s + 1) * 2.f * (float)M_PI / n};
+                    fan.push_back(centers[i]);
+                    fan.push_back({centers[i].x + cosf(a0) * radii[i], centers[i].y + sinf(a0) * radii[i]});
+                    fan.push_back({centers[i].x + cosf(a1) * radii[i], centers[i].y + sinf(a1) * radii[i]});
+                }
+                fan_vertices += fan.size();
+            }
+        })};
+
+        const auto instanced_circles {frame_seconds([&]
+        {
+            for(u32 i = 0; i < circles; i++){
+                shapes_2d.circle(centers[i], radii[i], {1.f, 1.f, 1.f, 1.f});
+            }
+        })};
+
+        u64 line_vertices {0};
+        Array<V2> triangles;
+        const auto uncached_lines {seconds([&]
+        {
+            line_vertices = 0;
+            for(auto& l : polylines)
+            {
+                VectorShapes::tessellate(l.data(), points, 5.f, VectorShapes::round, false, triangles);
+                line_vertices += triangles.size();
+            }
+        })};
+
+        const auto cached_lines {frame_seconds([&]
+        {
+            for(auto& l : polylines){
+                shapes_2d.polyline(l.data(), points, 5.f, {1.f, 1.f, 1.f, 1.f}, VectorShapes::round);
+            }
+        })};
+
+        printf("%-28s %12s %16s\n", "", "ms/frame", "shapes/s");
+        printf("%-28s %12.3f %16.0f   %.1f M vertices/s\n", "circles, tessellated", immediate_circles * 1000.f, circles / immediate_circles, fan_vertices / immediate_circles / 1e6);
+        printf("%-28s %12.3f %16.0f\n", "circles, instanced", instanced_circles * 1000.f, circles / instanced_circles);
+        printf("%-28s %12.3f %16.0f   %.1f M vertices/s\n", "polylines, tessellated", uncached_lines * 1000.f, lines / uncached_lines, line_vertices / uncached_lines / 1e6);
+        printf("%-28s %12.3f %16.0f\n", "polylines, cached", cached_lines * 1000.f, lines / cached_lines);
+
+        vkDeviceWaitIdle(context.gpu->device);
+        return 0;
+    }
+
+    // cpu cost of a set per draw: allocated, written and freed one at a time against the
+    // per frame pools, with every draw's binding distinct and with a few bindings reused
+    if(descriptor_bench)
+    {
+        constexpr u32 draws {10000};
+        constexpr u32 reused {64};
+        constexpr u32 iterations {20};
+        constexpr VkDeviceSize stride {256}; // at least minStorageBufferOffsetAlignment everywhere
+
+        const auto device {context.gpu->device};
+        VkResult err;
+
+        auto buffer {context.create_buffer(stride * draws, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)};
+
+        VkDescriptorSetLayout layout;
+        {
+            VkDescriptorSetLayoutBinding binding
+            {
+                .binding = 0,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+            };
+
+            VkDescriptorSetLayoutCreateInfo info
+            {
+                .sType = VKT(DESCRIPTOR_SET_LAYOUT_CREATE_INFO),
+                .bindingCount = 1,
+                .pBindings = &binding,
+            };
+            err = vkCreateDescriptorSetLayout(device, &info, nullptr, &layout);
+            check_vk(err);
+        }
+
+        VkDescriptorPool free_pool;
+        {
+            VkDescriptorPoolSize size {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = draws};
+            VkDescriptorPoolCreateInfo info
+            {
+                .sType = VKT(DESCRIPTOR_POOL_CREATE_INFO),
+                .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+                .maxSets = draws,
+                .poolSizeCount = 1,
+                .pPoolSizes = &size,
+            };
+            err = vkCreateDescriptorPool(device, &info, nullptr, &free_pool);
+            check_vk(err);
+        }
+
+        auto seconds {[](auto f)
+        {
+            const auto t0 {Time::now()};
+            for(u32 i = 0; i < iterations; i++){
+                f();
+            }
+            return Duration{Time::now() - t0}.count() / iterations;
+        }};
+
+        Array<VkDescriptorSet> sets(draws);
+        const auto individual {seconds([&]
+        {
+            for(u32 i = 0; i < draws; i++)
+            {
+                VkDescriptorSetAllocateInfo info
+                {
+                    .sType = VKT(DESCRIPTOR_SET_ALLOCATE_INFO),
+                    .descriptorPool = free_pool,
+                    .descriptorSetCount = 1,
+                    .pSetLayouts = &layout,
+                };
+                err = vkAllocateDescriptorSets(device, &info, &sets[i]);
+                check_vk(err);
+
+                VkDescriptorBufferInfo b {.buffer = buffer.buffer, .offset = (i % reused) * stride, .range = stride};
+                VkWriteDescriptorSet write
+                {
+                    .sType = VKT(WRITE_DESCRIPTOR_SET),
+                    .dstSet = sets[i],
+                    .dstBinding = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .pBufferInfo = &b,
+                };
+                vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+            }
+            vkFreeDescriptorSets(device, free_pool, draws, sets.data());
+        })};
+
+        // nothing is in flight, so the frame's pools can be reset right away
+        auto& descriptors {context.descriptors};
+        auto pooled {[&](const u32 distinct)
+        {
+            descriptors.totals = {};
+            return seconds([&]
+            {
+                descriptors.begin_frame();
+                for(u32 i = 0; i < draws; i++)
+                {
+                    const DescriptorAllocator::Binding b
+                    {
+                        .binding = 0,
+                        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        .buffer = {.buffer = buffer.buffer, .offset = (i % distinct) * stride, .range = stride},
+                    };
+                    sets[i] = descriptors.get(layout, &b, 1);
+                }
+            });
+        }};
+
+        const auto pooled_distinct {pooled(draws)};
+        const auto distinct_totals {descriptors.totals};
+        const auto pooled_reused {pooled(reused)};
+        const auto& st {descriptors.totals};
+
+        printf("%-28s %12s %16s\n", "", "ms/frame", "sets/s");
+        printf("%-28s %12.3f %16.0f\n", "allocate, write, free", individual * 1000.f, draws / individual);
+        printf("%-28s %12.3f %16.0f   %u pools created\n", "pooled, all distinct", pooled_distinct * 1000.f, draws / pooled_distinct,
+               distinct_totals.pools_created);
+        printf("%-28s %12.3f %16.0f   %u allocations %u cache hits (%.1f%%)\n", "pooled, 64 bindings", pooled_reused * 1000.f,
+               draws / pooled_reused, st.allocations, st.cache_hits, 100.f * st.cache_hits / st.requests);
+
+        descriptors.begin_frame();
+        vkDestroyDescriptorPool(device, free_pool, nullptr);
+        vkDestroyDescriptorSetLayout(device, layout, nullptr);
+        context.destroy_buffer(buffer);
+        return 0;
+    }
+
+    // offscreen scene plus a blurred thumbnail in the corner, built from blits:
+    // scene -> half -> quarter -> eighth -> thumbnail, half/eighth and quarter/thumbnail
+    // never live at the same time so they share memory
+    RenderGraph graph;
+    u32 backbuffer {};
+    if(use_graph)
+    {
+        graph.init(context);
+
+        const auto format {context.gpu->format.format};
+        const auto e {context.extent};
+        const auto scene {graph.create_image("scene", e, format)};
+        const auto half {graph.create_image("half", {e.width / 2, e.height / 2}, format)};
+        const auto quarter {graph.create_image("quarter", {e.width / 4, e.height / 4}, format)};
+        const auto eighth {graph.create_image("eighth", {e.width / 8, e.height / 8}, format)};
+        const auto thumbnail {graph.create_image("thumbnail", {e.width / 4, e.height / 4}, format)};
+        const auto unused {graph.create_image("unused", e, format)};
+
+        context.acquire_wait_stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+        backbuffer = graph.import_image("backbuffer", e, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                                        context.acquire_wait_stages);
+
+        auto blit {[&](VkCommandBuffer cmd, const u32 src, const u32 dst, const int x = 0, const int y = 0)
+        {
+            const auto& a {graph.resources[src]};
+            const auto& b {graph.resources[dst]};
+            VkImageBlit region
+            {
+                .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                .srcOffsets = {{0, 0, 0}, {(int)a.extent.width, (int)a.extent.height, 1}},
+                .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                .dstOffsets = {{x, y, 0}, {x + (int)a.extent.width, y + (int)a.extent.height, 1}},
+            };
+            if(x == 0 && y == 0){
+                region.dstOffsets[1] = {(int)b.extent.width, (int)b.extent.height, 1};
+            }
+            vkCmdBlitImage(cmd, a.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, b.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           1, &region, VK_FILTER_LINEAR);
+        }};
+
+        auto chain {[&](const String& name, const u32 src, const u32 dst)
+        {
+            auto& p {graph.add_pass(name)};
+            p.read(src, RenderGraph::transfer_src);
+            p.write(dst, RenderGraph::transfer_dst);
+            p.execute = [=](VkCommandBuffer cmd){ blit(cmd, src, dst); };
+        }};
+
+        {
+            auto& p {graph.add_pass("scene")};
+            p.write(scene, RenderGraph::color_attachment, true);
+            if(context.depth_enabled){
+                p.write(graph.create_image("depth", e, context.depth_format, VK_IMAGE_ASPECT_DEPTH_BIT), RenderGraph::depth_attachment, true);
+            }
+            p.clear_color = clear;
+            p.execute = [&](VkCommandBuffer){ draw_scene(); };
+        }
+
+        chain("downsample_half", scene, half);
+        chain("downsample_quarter", half, quarter);
+        chain("downsample_eighth", quarter, eighth);
+        chain("upsample", eighth, thumbnail);
+
+        {
+            // never read, culled
+            auto& p {graph.add_pass("debug_copy")};
+            p.read(scene, RenderGraph::transfer_src);
+            p.write(unused, RenderGraph::transfer_dst);
+            p.execute = [=](VkCommandBuffer cmd){ blit(cmd, scene, unused); };
+        }
+
+        {
+            auto& p {graph.add_pass("composite")};
+            p.read(scene, RenderGraph::transfer_src);
+            p.write(backbuffer, RenderGraph::transfer_dst);
+            p.execute = [=](VkCommandBuffer cmd){ blit(cmd, scene, backbuffer); };
+        }
+
+        {
+            auto& p {graph.add_pass("thumbnail")};
+            p.read(thumbnail, RenderGraph::transfer_src);
+            p.write(backbuffer, RenderGraph::transfer_dst);
+            p.execute = [=](VkCommandBuffer cmd){ blit(cmd, thumbnail, backbuffer, 16, 16); };
+        }
+
+        graph.compile();
+    }
 
     auto start {Time::now()};
     auto end {Time::now()};
 
     float delta {};
     u64 frame {0};
-    float angle {0.f};
+
+    // scripted run: no input, the cursor follows a fixed path and the run stops after the last frame
+    Benchmark benchmark;
+    benchmark.init(benchmark_warmup, benchmark_frames);
+    auto previous_start {Time::now()};
 
     constexpr auto dt {1.f / 60.f};
 
+    // every pipeline exists by now, a saved shader rebuilds the ones that loaded it
+    ShaderReloader reloader;
+    if(watch_shaders && !software)
+    {
+        if(!shader_compiler.empty()){
+            reloader.compiler = shader_compiler;
+        }
+        watch_shaders = reloader.init(context, shader_dir);
+    }
+
     while(running)
     {
         start = Time::now();
         delta = Duration{end - start}.count();
+
+        if(benchmark_frames)
+        {
+            if(frame > 0){
+                benchmark.add(context.timings, std::chrono::duration<float, std::milli>{start - previous_start}.count());
+            }
+            if(benchmark.done()){
+                break;
+            }
+        }
+        previous_start = start;
+
         SDL_Event e;
         while(SDL_PollEvent(&e))
         {
@@ -293,6 +1537,10 @@ int main()
             }
         }
 
+        if(benchmark_frames){
+            script_mouse(frame);
+        }
+        else
         {
             int x;
             int y;
@@ -307,22 +1555,170 @@ int main()
             angle = 0.0f;
         }
 
-        context.render_reset(clear);
+        update_scene();
+
+        if(stream.capturing()){
+            stream.begin_frame(clear);
+        }
+
+        if(use_graph)
+        {
+            context.begin_frame();
+            graph.set_image(backbuffer, context.gpu->swapchain_images[context.swapchain_image],
+                            context.gpu->swapchain_image_views[context.swapchain_image]);
+            graph.execute(context.command_buffer);
+        }
+        else if(text_labels || vector_shapes || meshes || particles)
+        {
+            // overlays write their buffers after begin_frame has waited for the last frame
+            context.begin_frame();
 
-        i_render_triangle(immediate_pipeline, {500, 0}, {10, 100}, { 510, 80}, {1.f, 1.f, 1.f, 1.f}, angle);
+            if(meshes){
+                mesh.update(context.command_buffer);
+            }
 
-        render_triangle(immediate_pipeline, {500,  300}, {400, 450}, {575, 400}, {1.f, 0.f, 1.f, 1.f}, {0, 1.f, 1.f, 1.f}, {1.f, 1.f, 0, 1.f}, angle);
+            if(particles){
+                particle_system.update(context.command_buffer, dt, mouse, (u32)(particles * dt / particle_life));
+            }
 
-        i_render_triangle(immediate_pipeline, {510,  300}, {600, 600}, {550, 400}, {0, 0.f, 1.f, 1.f}, angle);
+            if(text_labels)
+            {
+                const auto t0 {Time::now()};
+                text.begin_frame();
+                build_labels(frame);
+                text_ms = std::chrono::duration<float, std::milli>{Time::now() - t0}.count();
+                text.upload(context.command_buffer);
+            }
 
-        i_render_triangle(immediate_pipeline, {550,  300}, {650, 600}, {580, 350}, {1, 0.f, 0.f, 1.f}, angle);
+            if(vector_shapes)
+            {
+                const auto t0 {Time::now()};
+                shapes_2d.begin_frame();
+                build_shapes(frame);
+                shapes_ms = std::chrono::duration<float, std::milli>{Time::now() - t0}.count();
+            }
 
-        V2 size {720, 720};
-        render_rectangle(additive_pipeline, {mouse.x - size.x * 0.5f, mouse.y - size.y * 0.5f}, size, {0, 1, 0, 1.f});
+            context.begin_render_pass(clear);
+            if(meshes){
+                mesh.draw(context.command_buffer);
+            }
+            draw_scene();
+            if(particles){
+                particle_system.draw(context.command_buffer);
+            }
+            if(vector_shapes){
+                shapes_2d.draw(context.command_buffer);
+            }
+            if(text_labels){
+                text.draw(context.command_buffer);
+            }
+        }
+        else
+        {
+            context.render_reset(clear);
+            draw_scene();
+        }
 
         context.present();
+        stream.end_frame();
+
+        if(watch_shaders){
+            reloader.end_frame();
+        }
+
+        if(graph_dump){
+            printf("frame %llu\n%s", (unsigned long long)frame, graph.dump().c_str());
+        }
+
+        if(queue_stats)
+        {
+            const auto& st {queue.stats};
+            printf("frame %llu draws %u binds %u -> %u pushes %u skipped %u\n",
+                   (unsigned long long)frame, st.draws, st.binds_unsorted, st.binds, st.pushes, st.pushes_skipped);
+            if(clip_panels)
+            {
+                printf("frame %llu clip trimmed %u into %u draws culled %u scissored %u scissor changes %u batch breaks %u\n",
+                       (unsigned long long)frame, st.trimmed, st.trim_draws, st.clip_culled, st.scissored, st.scissor_changes, st.batch_breaks);
+            }
+        }
+
+        // results lag a frame behind, they are read back once the fence says the frame is done
+        if(overdraw_stats && context.statistics_pool)
+        {
+            const auto pixels {(double)context.extent.width * context.extent.height};
+            printf("frame %llu fragment invocations %llu overdraw %.3f\n",
+                   (unsigned long long)frame, (unsigned long long)context.fragment_invocations,
+                   context.fragment_invocations / pixels);
+        }
+
+        if(text_stats && text_labels)
+        {
+            const auto& st {text.stats};
+            const auto lookups {st.layout_hits + st.layout_misses};
+            printf("frame %llu labels %u glyphs %u dropped %u layout hits %u misses %u (%.1f%%) cached %u atlas %u layout %.3f ms\n",
+                   (unsigned long long)frame, st.labels, st.glyphs, st.dropped, st.layout_hits, st.layout_misses,
+                   lookups ? 100.f * st.layout_hits / lookups : 0.f, st.cached, st.rasterized, text_ms);
+        }
+
+        if(shape_stats && vector_shapes)
+        {
+            const auto& st {shapes_2d.stats};
+            printf("frame %llu shapes %u draws %u line vertices %u line hits %u misses %u dropped %u build %.3f ms\n",
+                   (unsigned long long)frame, st.instances, st.draws, st.line_vertices, st.line_hits, st.line_misses, st.dropped, shapes_ms);
+        }
+
+        if(meshes && mesh.stats.frame_uploaded && mesh.resident())
+        {
+            const auto& st {mesh.stats};
+            const auto mb {mesh.file_size() / 1e6f};
+            printf("mesh %s: %.1f MB file, %.1f MB uploaded in %u frames, first draw %.1f ms, resident %.1f ms, %.1f MB/s\n",
+                   mesh_path.c_str(), mb, st.uploaded / 1e6f, st.frames, st.first_draw_ms, st.load_ms, mb / (st.load_ms / 1000.f));
+        }
+
+        if(particle_stats && particles)
+        {
+            const auto& st {particle_system.stats};
+            printf("frame %llu particles alive %u spawned %u gpu %.3f ms\n",
+                   (unsigned long long)frame, st.alive, st.spawned, st.gpu_ms);
+        }
+
+        if(memory_stats)
+        {
+            const auto& f {context.memory.frame};
+            printf("frame %llu memory %s, allocated %.1f MB (%u) freed %.1f MB (%u)\n",
+                   (unsigned long long)frame, context.memory.summary().c_str(), f.allocated / 1e6, f.allocations, f.freed / 1e6, f.frees);
+        }
+
+        if(grid_stats)
+        {
+            const auto& st {grid.stats};
+            printf("frame %llu visible %u culled %u cells %u query %.3f ms\n",
+                   (unsigned long long)frame, st.visible, st.culled, st.cells_visited, st.query_ms);
+        }
 
         end = Time::now();
         frame++;
     }
+
+    stream.close();
+
+    if(watch_shaders){
+        reloader.destroy();
+    }
+
+    if(use_graph){
+        graph.destroy();
+    }
+
+    if(meshes){
+        mesh.destroy();
+    }
+
+    if(particles){
+        particle_system.destroy();
+    }
+
+    if(benchmark_frames){
+        write_benchmark(benchmark, "main");
+    }
 }
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+
+#include "types.hpp"
+#include "utilities.hpp"
+
+// every device allocation by category and heap, checked against the driver's budget
+//
+// with VK_EXT_memory_budget the budget and usage per heap come from the driver and
+// include other processes, without it the budget is the heap size and the usage is
+// whatever this process tracked. swapchain images belong to the presentation engine,
+// so they are an estimate
+struct MemoryTelemetry
+{
+    enum Category : u32
+    {
+        swapchain,
+        attachments,
+        buffers,
+        staging,
+        textures,
+        category_count,
+        automatic = category_count, // picked from usage and memory properties
+    };
+
+    static constexpr const char* names[category_count] {"swapchain", "attachments", "buffers", "staging", "textures"};
+
+    struct Allocation
+    {
+        Category category;
+        u32 heap;
+        VkDeviceSize size;
+    };
+
+    struct Totals
+    {
+        u64 bytes {0};
+        u32 count {0};
+    };
+
+    struct Heap
+    {
+        u64 size {0};
+        u64 tracked {0};
+        u64 budget {0};
+        u64 usage {0};
+        bool device_local {false};
+        bool over {false}; // warned, cleared once usage drops below the line again
+    };
+
+    // reset by begin_frame
+    struct Frame
+    {
+        u64 allocated {0};
+        u64 freed {0};
+        u32 allocations {0};
+        u32 frees {0};
+    };
+
+    VkPhysicalDevice gpu {VK_NULL_HANDLE};
+    const VkPhysicalDeviceMemoryProperties* properties {nullptr};
+    bool budget_extension {false};
+
+    // of the heap budget, crossing it prints a warning
+    float warn_fraction {0.9f};
+
+    Totals totals[category_count];
+    Array<Heap> heaps;
+    Frame frame;
+    u64 peak {0};
+    u32 warnings {0};
+
+    std::unordered_map<VkDeviceMemory, Allocation> allocations;
+    u64 swapchain_bytes {0};
+
+    void init(VkPhysicalDevice device, const VkPhysicalDeviceMemoryProperties& p, const bool has_budget_extension)
+    {
+        gpu = device;
+        properties = &p;
+        budget_extension = has_budget_extension;
+
+        heaps.assign(p.memoryHeapCount, {});
+        for(u32 i = 0; i < p.memoryHeapCount; i++)
+        {
+            heaps[i].size = p.memoryHeaps[i].size;
+            heaps[i].budget = p.memoryHeaps[i].size;
+            heaps[i].device_local = p.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        }
+    }
+
+    static Category buffer_category(const VkBufferUsageFlags usage, const VkMemoryPropertyFlags flags)
+    {
+        const auto transfer_only {(usage & ~(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)) == 0};
+        return (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && transfer_only ? staging : buffers;
+    }
+
+    static Category image_category(const VkImageUsageFlags usage)
+    {
+        constexpr VkImageUsageFlags attachment {VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                                VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT};
+        return usage & attachment ? attachments : textures;
+    }
+
+    u64 total() const
+    {
+        u64 sum {0};
+        for(auto& t : totals){
+            sum += t.bytes;
+        }
+        return sum;
+    }
+
+    void add(const Category category, const u32 heap, const u64 size)
+    {
+        totals[category].bytes += size;
+        totals[category].count++;
+        heaps[heap].tracked += size;
+        peak = std::max(peak, total());
+    }
+
+    void remove(const Category category, const u32 heap, const u64 size)
+    {
+        totals[category].bytes -= size;
+        totals[category].count--;
+        heaps[heap].tracked -= size;
+    }
+
+    void track(VkDeviceMemory memory, const Category category, const u32 memory_type, const VkDeviceSize size)
+    {
+        const auto heap {properties->memoryTypes[memory_type].heapIndex};
+        allocations[memory] = {category, heap, size};
+        add(category, heap, size);
+
+        frame.allocated += size;
+        frame.allocations++;
+    }
+
+    // before vkFreeMemory
+    void release(VkDeviceMemory memory)
+    {
+        const auto it {allocations.find(memory)};
+        if(it == allocations.end()){
+            return;
+        }
+
+        const auto& a {it->second};
+        remove(a.category, a.heap, a.size);
+        frame.freed += a.size;
+        frame.frees++;
+        allocations.erase(it);
+    }
+
+    // images times an assumed four bytes per pixel, on the first device local heap
+    void track_swapchain(const u32 images, const VkExtent2D extent)
+    {
+        u32 heap {0};
+        for(u32 i = 0; i < heaps.size(); i++)
+        {
+            if(heaps[i].device_local)
+            {
+                heap = i;
+                break;
+            }
+        }
+
+        if(swapchain_bytes){
+            remove(swapchain, heap, swapchain_bytes);
+        }
+        swapchain_bytes = (u64)images * extent.width * extent.height * 4;
+        add(swapchain, heap, swapchain_bytes);
+    }
+
+    // after the frame fence, refreshes the budget and warns about heaps over warn_fraction of it
+    void begin_frame()
+    {
+        frame = {};
+
+        if(budget_extension)
+        {
+            VkPhysicalDeviceMemoryBudgetPropertiesEXT budget {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT};
+            VkPhysicalDeviceMemoryProperties2 p
+            {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+                .pNext = &budget,
+            };
+            vkGetPhysicalDeviceMemoryProperties2(gpu, &p);
+
+            for(u32 i = 0; i < heaps.size(); i++)
+            {
+                heaps[i].budget = budget.heapBudget[i];
+                heaps[i].usage = budget.heapUsage[i];
+            }
+        }
+        else
+        {
+            for(auto& h : heaps){
+                h.usage = h.tracked;
+            }
+        }
+
+        for(u32 i = 0; i < heaps.size(); i++)
+        {
+            auto& h {heaps[i]};
+            const auto over {h.budget && h.usage > warn_fraction * h.budget};
+            if(over && !h.over)
+            {
+                fprintf(stderr, "memory: heap %u%s at %.1f of %.1f MB budget (%.0f%%), %.1f MB tracked here\n",
+                        i, h.device_local ? " (device local)" : "", h.usage / 1e6, h.budget / 1e6,
+                        100.0 * h.usage / h.budget, h.tracked / 1e6);
+                warnings++;
+            }
+            h.over = over;
+        }
+    }
+
+    String summary() const
+    {
+        String out;
+        char line[128];
+        for(u32 i = 0; i < category_count; i++)
+        {
+            snprintf(line, sizeof(line), "%s%s %.1f MB (%u)", i ? " " : "", names[i], totals[i].bytes / 1e6, totals[i].count);
+            out += line;
+        }
+        for(u32 i = 0; i < heaps.size(); i++)
+        {
+            const auto& h {heaps[i]};
+            snprintf(line, sizeof(line), ", heap %u %.1f / %.1f MB", i, h.usage / 1e6, h.budget / 1e6);
+            out += line;
+        }
+        return out;
+    }
+
+    String json() const
+    {
+        String out;
+        char line[256];
+
+        snprintf(line, sizeof(line), "{\"budget_extension\": %s, \"peak_bytes\": %llu, \"warnings\": %u, \"categories\": {",
+                 budget_extension ? "true" : "false", (unsigned long long)peak, warnings);
+        out += line;
+        for(u32 i = 0; i < category_count; i++)
+        {
+            snprintf(line, sizeof(line), "%s\"%s\": {\"bytes\": %llu, \"allocations\": %u}",
+                     i ? ", " : "", names[i], (unsigned long long)totals[i].bytes, totals[i].count);
+            out += line;
+        }
+        out += "}, \"heaps\": [";
+        for(u32 i = 0; i < heaps.size(); i++)
+        {
+            const auto& h {heaps[i]};
+            snprintf(line, sizeof(line), "%s{\"size\": %llu, \"budget\": %llu, \"usage\": %llu, \"tracked\": %llu, \"device_local\": %s}",
+                     i ? ", " : "", (unsigned long long)h.size, (unsigned long long)h.budget, (unsigned long long)h.usage,
+                     (unsigned long long)h.tracked, h.device_local ? "true" : "false");
+            out += line;
+        }
+        out += "]}";
+        return out;
+    }
+};
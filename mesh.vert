@@ -0,0 +1,27 @@
+#version 450
+
+// matches MeshVertex, scalars only so std430 keeps it at 16 bytes
+struct Vertex
+{
+    float x;
+    float y;
+    float z;
+    uint color;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Vertices { Vertex vertices[]; };
+
+layout(push_constant) uniform Data
+{
+    vec4 scale;
+    vec4 offset;
+};
+
+layout(location = 0) out vec4 color;
+
+void main()
+{
+    Vertex v = vertices[gl_VertexIndex];
+    gl_Position = vec4(vec3(v.x, v.y, v.z) * scale.xyz + offset.xyz, 1);
+    color = unpackUnorm4x8(v.color);
+}
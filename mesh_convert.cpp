@@ -0,0 +1,439 @@
+// offline converter to the .mesh format read by MeshStreamer
+//
+//   mesh_convert input.obj output.mesh [--chunk-triangles N] [--no-optimize]
+//   mesh_convert --grid N output.mesh [--chunk-triangles N] [--no-optimize]
+//
+// triangles are reordered for the post transform vertex cache (Forsyth's linear speed
+// optimizer), vertices are then renumbered in order of first use and the index
+// buffer is cut into chunks that can be drawn as soon as they are resident
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "types.hpp"
+#include "mesh_format.hpp"
+
+struct Mesh
+{
+    Array<MeshVertex> vertices;
+    Array<u32> indices;
+};
+
+static u32 pack_color(const float r, const float g, const float b)
+{
+    auto c {[](const float v){ return (u32)(std::clamp(v, 0.f, 1.f) * 255.f + 0.5f); }};
+    return c(r) | c(g) << 8 | c(b) << 16 | 0xffu << 24;
+}
+
+// v x y z [r g b] and f lines, polygons are fanned, texture and normal indices ignored
+static bool load_obj(const char* path, Mesh& mesh)
+{
+    std::ifstream f {path};
+    if(!f){
+        return false;
+    }
+
+    Array<bool> colored;
+    String line;
+    Array<u32> face;
+    while(std::getline(f, line))
+    {
+        std::istringstream s {line};
+        String tag;
+        s >> tag;
+
+        if(tag == "v")
+        {
+            MeshVertex v {};
+            float r;
+            float g;
+            float b;
+            s >> v.x >> v.y >> v.z;
+            const auto has_color {(bool)(s >> r >> g >> b)};
+            v.color = has_color ? pack_color(r, g, b) : 0;
+            mesh.vertices.push_back(v);
+            colored.push_back(has_color);
+        }
+        else if(tag == "f")
+        {
+            face.clear();
+            String corner;
+            while(s >> corner)
+            {
+                const long i {std::strtol(corner.c_str(), nullptr, 10)};
+                face.push_back(i < 0 ? mesh.vertices.size() + i : i - 1);
+            }
+            for(size_t i = 2; i < face.size(); i++)
+            {
+                mesh.indices.push_back(face[0]);
+                mesh.indices.push_back(face[i - 1]);
+                mesh.indices.push_back(face[i]);
+            }
+        }
+    }
+
+    // uncolored vertices are shaded by height
+    float lo {INFINITY};
+    float hi {-INFINITY};
+    for(auto& v : mesh.vertices)
+    {
+        lo = std::min(lo, v.z);
+        hi = std::max(hi, v.z);
+    }
+    for(size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        if(!colored[i])
+        {
+            const auto t {hi > lo ? (mesh.vertices[i].z - lo) / (hi - lo) : 0.5f};
+            mesh.vertices[i].color = pack_color(0.2f + 0.8f * t, 0.4f + 0.4f * t, 1.f - 0.6f * t);
+        }
+    }
+
+    for(auto i : mesh.indices)
+    {
+        if(i >= mesh.vertices.size()){
+            return false;
+        }
+    }
+    return true;
+}
+
+// n x n quads of a rolling height field, 2 n^2 triangles, indexed row by row
+static void generate_grid(const u32 n, Mesh& mesh)
+{
+    for(u32 y = 0; y <= n; y++)
+    {
+        for(u32 x = 0; x <= n; x++)
+        {
+            const auto u {(float)x / n};
+            const auto v {(float)y / n};
+            const auto h {0.5f + 0.25f * sinf(u * 17.f) * cosf(v * 13.f) + 0.25f * sinf((u + v) * 41.f)};
+            mesh.vertices.push_back({u, v, h, pack_color(h, 0.3f + 0.5f * v, 1.f - h)});
+        }
+    }
+
+    for(u32 y = 0; y < n; y++)
+    {
+        for(u32 x = 0; x < n; x++)
+        {
+            const auto i {y * (n + 1) + x};
+            mesh.indices.insert(mesh.indices.end(), {i, i + 1, i + n + 1, i + 1, i + n + 2, i + n + 1});
+        }
+    }
+}
+
+// average cache miss ratio: transformed vertices per triangle through a fifo cache
+static float acmr(const Array<u32>& indices, const u32 cache_size = 32)
+{
+    Array<u32> fifo(cache_size, ~0u);
+    u32 head {0};
+    u64 misses {0};
+    for(auto i : indices)
+    {
+        if(std::find(fifo.begin(), fifo.end(), i) != fifo.end()){
+            continue;
+        }
+        fifo[head] = i;
+        head = (head + 1) % cache_size;
+        misses++;
+    }
+    return indices.empty() ? 0.f : (float)misses / (indices.size() / 3);
+}
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation": greedily emit the triangle whose
+// vertices score highest, vertices score for being recently used and for having few
+// triangles left, which finishes off regions instead of leaving islands
+static void optimize_vertex_cache(Array<u32>& indices, const u32 vertex_count)
+{
+    constexpr int cache_size {32};
+    const u32 triangle_count = indices.size() / 3;
+
+    Array<u32> offsets(vertex_count + 1, 0);
+    for(auto i : indices){
+        offsets[i + 1]++;
+    }
+    for(u32 v = 0; v < vertex_count; v++){
+        offsets[v + 1] += offsets[v];
+    }
+
+    // per vertex the triangles not emitted yet are kept at the front of its range
+    Array<u32> adjacency(indices.size());
+    Array<u32> remaining(vertex_count, 0);
+    for(u32 t = 0; t < triangle_count; t++)
+    {
+        for(int k = 0; k < 3; k++)
+        {
+            const auto v {indices[t * 3 + k]};
+            adjacency[offsets[v] + remaining[v]++] = t;
+        }
+    }
+
+    auto score {[](const int position, const u32 left)
+    {
+        if(left == 0){
+            return -1.f;
+        }
+
+        float s {0.f};
+        if(position >= 0)
+        {
+            // the last triangle's vertices get a fixed score so its neighbours aren't favoured over each other
+            s = position < 3 ? 0.75f : powf(1.f - (float)(position - 3) / (cache_size - 3), 1.5f);
+        }
+        return s + 2.f / sqrtf((float)left);
+    }};
+
+    Array<int> position(vertex_count, -1);
+    Array<float> vertex_score(vertex_count);
+    for(u32 v = 0; v < vertex_count; v++){
+        vertex_score[v] = score(-1, remaining[v]);
+    }
+
+    Array<float> triangle_score(triangle_count);
+    Array<bool> emitted(triangle_count, false);
+    for(u32 t = 0; t < triangle_count; t++){
+        triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+    }
+
+    Array<u32> out;
+    out.reserve(indices.size());
+
+    u32 cache[cache_size + 3];
+    int cached {0};
+    u32 scan {0};
+    auto best {~0u};
+
+    while(out.size() < indices.size())
+    {
+        if(best == ~0u)
+        {
+            // nothing useful in the cache, take the next triangle not emitted yet
+            while(emitted[scan]){
+                scan++;
+            }
+            best = scan;
+        }
+
+        const u32 tri[3] {indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2]};
+        emitted[best] = true;
+        out.insert(out.end(), tri, tri + 3);
+
+        for(auto v : tri)
+        {
+            auto* list {&adjacency[offsets[v]]};
+            for(u32 i = 0; i < remaining[v]; i++)
+            {
+                if(list[i] == best)
+                {
+                    std::swap(list[i], list[remaining[v] - 1]);
+                    remaining[v]--;
+                    break;
+                }
+            }
+        }
+
+        // move the triangle's vertices to the front of the lru
+        u32 next[cache_size + 3];
+        int n {0};
+        for(auto v : tri){
+            next[n++] = v;
+        }
+        for(int i = 0; i < cached; i++)
+        {
+            const auto v {cache[i]};
+            if(v != tri[0] && v != tri[1] && v != tri[2]){
+                next[n++] = v;
+            }
+        }
+
+        for(int i = 0; i < n; i++)
+        {
+            const auto v {next[i]};
+            position[v] = i < cache_size ? i : -1;
+            vertex_score[v] = score(position[v], remaining[v]);
+        }
+
+        // rescore the triangles around the cache and pick the best of them
+        best = ~0u;
+        float best_score {-1.f};
+        for(int i = 0; i < n; i++)
+        {
+            const auto v {next[i]};
+            for(u32 j = 0; j < remaining[v]; j++)
+            {
+                const auto t {adjacency[offsets[v] + j]};
+                const auto s {vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]]};
+                triangle_score[t] = s;
+                if(s > best_score)
+                {
+                    best_score = s;
+                    best = t;
+                }
+            }
+        }
+
+        cached = std::min(n, cache_size);
+        std::copy(next, next + cached, cache);
+    }
+
+    indices.swap(out);
+}
+
+// renumber vertices in order of first use so chunks only reach back, never forward
+static void reorder_vertices(Mesh& mesh)
+{
+    Array<u32> remap(mesh.vertices.size(), ~0u);
+    Array<MeshVertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+
+    for(auto& i : mesh.indices)
+    {
+        if(remap[i] == ~0u)
+        {
+            remap[i] = vertices.size();
+            vertices.push_back(mesh.vertices[i]);
+        }
+        i = remap[i];
+    }
+
+    // unreferenced vertices are dropped
+    mesh.vertices.swap(vertices);
+}
+
+static bool write_mesh(const char* path, const Mesh& mesh, const u32 chunk_triangles)
+{
+    Array<MeshChunk> chunks;
+    u32 vertex_end {0};
+    for(u32 first = 0; first < mesh.indices.size(); first += chunk_triangles * 3)
+    {
+        const u32 count = std::min<size_t>(chunk_triangles * 3, mesh.indices.size() - first);
+        for(u32 i = first; i < first + count; i++){
+            vertex_end = std::max(vertex_end, mesh.indices[i] + 1);
+        }
+        chunks.push_back({first, count, vertex_end, 0});
+    }
+
+    MeshHeader h {};
+    h.magic = mesh_magic;
+    h.version = mesh_version;
+    h.vertex_stride = sizeof(MeshVertex);
+    h.chunk_count = chunks.size();
+    h.vertex_count = mesh.vertices.size();
+    h.index_count = mesh.indices.size();
+    h.chunk_offset = mesh_align(sizeof(MeshHeader));
+    h.vertex_offset = mesh_align(h.chunk_offset + sizeof(MeshChunk) * chunks.size());
+    h.index_offset = mesh_align(h.vertex_offset + sizeof(MeshVertex) * mesh.vertices.size());
+    h.file_size = mesh_align(h.index_offset + sizeof(u32) * mesh.indices.size());
+
+    for(int k = 0; k < 3; k++)
+    {
+        h.bounds_min[k] = INFINITY;
+        h.bounds_max[k] = -INFINITY;
+    }
+    for(auto& v : mesh.vertices)
+    {
+        const float p[3] {v.x, v.y, v.z};
+        for(int k = 0; k < 3; k++)
+        {
+            h.bounds_min[k] = std::min(h.bounds_min[k], p[k]);
+            h.bounds_max[k] = std::max(h.bounds_max[k], p[k]);
+        }
+    }
+
+    std::ofstream f {path, std::ios::binary | std::ios::trunc};
+    if(!f){
+        return false;
+    }
+
+    auto section {[&](const u64 offset, const void* data, const u64 size)
+    {
+        // zero padding up to the aligned offset
+        static const char zeros[mesh_alignment] {};
+        const auto at {(u64)f.tellp()};
+        f.write(zeros, offset - at);
+        f.write((const char*)data, size);
+    }};
+
+    f.write((const char*)&h, sizeof(h));
+    section(h.chunk_offset, chunks.data(), sizeof(MeshChunk) * chunks.size());
+    section(h.vertex_offset, mesh.vertices.data(), sizeof(MeshVertex) * mesh.vertices.size());
+    section(h.index_offset, mesh.indices.data(), sizeof(u32) * mesh.indices.size());
+    section(h.file_size, nullptr, 0);
+
+    return (bool)f;
+}
+
+int main(int argc, char** argv)
+{
+    const char* input {nullptr};
+    const char* output {nullptr};
+    u32 grid {0};
+    u32 chunk_triangles {1 << 16};
+    auto optimize {true};
+
+    for(int i = 1; i < argc; i++)
+    {
+        const String arg {argv[i]};
+        if(arg == "--grid" && i + 1 < argc){
+            grid = std::stoul(argv[++i]);
+        }
+        else if(arg == "--chunk-triangles" && i + 1 < argc){
+            chunk_triangles = std::max(1ul, std::stoul(argv[++i]));
+        }
+        else if(arg == "--no-optimize"){
+            optimize = false;
+        }
+        else if(!input && !grid){
+            input = argv[i];
+        }
+        else{
+            output = argv[i];
+        }
+    }
+
+    if((!input && !grid) || !output)
+    {
+        fprintf(stderr, "usage: mesh_convert (input.obj | --grid N) output.mesh [--chunk-triangles N] [--no-optimize]\n");
+        return 1;
+    }
+
+    using Clock = std::chrono::high_resolution_clock;
+    auto seconds {[](auto a, auto b){ return std::chrono::duration<float>{b - a}.count(); }};
+
+    Mesh mesh;
+    const auto t0 {Clock::now()};
+    if(grid){
+        generate_grid(grid, mesh);
+    }
+    else if(!load_obj(input, mesh))
+    {
+        fprintf(stderr, "could not read %s\n", input);
+        return 1;
+    }
+    const auto t1 {Clock::now()};
+
+    const auto before {acmr(mesh.indices)};
+    if(optimize){
+        optimize_vertex_cache(mesh.indices, mesh.vertices.size());
+    }
+    reorder_vertices(mesh);
+    const auto after {acmr(mesh.indices)};
+    const auto t2 {Clock::now()};
+
+    if(!write_mesh(output, mesh, chunk_triangles))
+    {
+        fprintf(stderr, "could not write %s\n", output);
+        return 1;
+    }
+    const auto t3 {Clock::now()};
+
+    printf("%zu vertices, %zu triangles, %u triangles per chunk\n", mesh.vertices.size(), mesh.indices.size() / 3, chunk_triangles);
+    printf("acmr (fifo 32) %.3f -> %.3f\n", before, after);
+    printf("load %.3f s, optimize %.3f s, write %.3f s\n", seconds(t0, t1), seconds(t1, t2), seconds(t2, t3));
+    return 0;
+}
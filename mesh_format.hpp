@@ -0,0 +1,96 @@
+#pragma once
+
+#include "types.hpp"
+
+// .mesh files, written by mesh_convert and memory mapped by MeshStreamer
+//
+// header | chunk table | vertices | indices, every section starts on a mesh_alignment
+// boundary so it can be copied straight out of the mapping
+//
+// vertices are stored in order of first use and chunks in index order, so every chunk
+// only references vertices below its vertex_end. once the vertices up to vertex_end and
+// the chunk's indices are resident the chunk can be drawn, without the rest of the file
+constexpr u32 mesh_magic {0x4853454d}; // "MESH"
+constexpr u32 mesh_version {1};
+constexpr u64 mesh_alignment {4096};
+
+struct MeshVertex
+{
+    float x;
+    float y;
+    float z;
+    u32 color; // rgba8
+};
+
+struct MeshChunk
+{
+    u32 index_first;
+    u32 index_count;
+    u32 vertex_end;
+    u32 pad;
+};
+
+struct MeshHeader
+{
+    u32 magic;
+    u32 version;
+    u32 vertex_stride;
+    u32 chunk_count;
+    u64 vertex_count;
+    u64 index_count;
+    u64 chunk_offset;
+    u64 vertex_offset;
+    u64 index_offset;
+    u64 file_size;
+    float bounds_min[3];
+    float bounds_max[3];
+};
+
+inline u64 mesh_align(const u64 v)
+{
+    return (v + mesh_alignment - 1) & ~(mesh_alignment - 1);
+}
+
+// whether offset + count * stride stays inside size, without overflowing
+inline bool mesh_section_fits(const u64 offset, const u64 count, const u64 stride, const u64 size)
+{
+    return offset <= size && count <= (size - offset) / stride;
+}
+
+// null when the data isn't a mesh file this code can read. the chunk table is checked
+// too, chunks have to cover the indices in order and stay within the vertices, so a
+// damaged file can't make the streamer copy past the end of anything. the index values
+// aren't read here, the streamer checks them against vertex_end as it copies them
+inline const MeshHeader* mesh_header(const void* data, const u64 size)
+{
+    if(size < sizeof(MeshHeader)){
+        return nullptr;
+    }
+
+    const auto* h {(const MeshHeader*)data};
+    if(h->magic != mesh_magic || h->version != mesh_version || h->vertex_stride != sizeof(MeshVertex)){
+        return nullptr;
+    }
+    if(h->file_size > size || !mesh_section_fits(h->index_offset, h->index_count, sizeof(u32), size) ||
+       !mesh_section_fits(h->vertex_offset, h->vertex_count, sizeof(MeshVertex), size) ||
+       !mesh_section_fits(h->chunk_offset, h->chunk_count, sizeof(MeshChunk), size) || h->chunk_offset % alignof(MeshChunk)){
+        return nullptr;
+    }
+
+    const auto* chunks {(const MeshChunk*)((const u8*)data + h->chunk_offset)};
+    u64 index_end {0};
+    u64 vertex_end {0};
+    for(u32 i = 0; i < h->chunk_count; i++)
+    {
+        const auto& c {chunks[i]};
+        if(c.index_first != index_end || c.vertex_end < vertex_end || c.vertex_end > h->vertex_count){
+            return nullptr;
+        }
+        index_end += c.index_count;
+        vertex_end = c.vertex_end;
+    }
+    if(index_end > h->index_count){
+        return nullptr;
+    }
+    return h;
+}
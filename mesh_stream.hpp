@@ -0,0 +1,464 @@
+#pragma once
+
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "context.hpp"
+#include "mesh_format.hpp"
+#include "utilities.hpp"
+
+// read only view of a whole file, pages are faulted in as they are first touched
+struct MappedFile
+{
+    const u8* data {nullptr};
+    u64 size {0};
+
+#ifdef _WIN32
+    HANDLE file {INVALID_HANDLE_VALUE};
+    HANDLE mapping {nullptr};
+
+    bool open(const char* path)
+    {
+        file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if(file == INVALID_HANDLE_VALUE){
+            return false;
+        }
+
+        LARGE_INTEGER length;
+        GetFileSizeEx(file, &length);
+        size = length.QuadPart;
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(mapping){
+            data = (const u8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+        if(!data)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if(data){
+            UnmapViewOfFile(data);
+        }
+        if(mapping){
+            CloseHandle(mapping);
+        }
+        if(file != INVALID_HANDLE_VALUE){
+            CloseHandle(file);
+        }
+        data = nullptr;
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+        size = 0;
+    }
+#else
+    bool open(const char* path)
+    {
+        const int fd {::open(path, O_RDONLY)};
+        if(fd < 0){
+            return false;
+        }
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        size = st.st_size;
+
+        // the mapping keeps its own reference to the file
+        auto* p {mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)};
+        ::close(fd);
+        if(p == MAP_FAILED)
+        {
+            size = 0;
+            return false;
+        }
+
+        // read front to back, let the kernel read ahead
+        madvise(p, size, MADV_SEQUENTIAL);
+        data = (const u8*)p;
+        return true;
+    }
+
+    void close()
+    {
+        if(data){
+            munmap((void*)data, size);
+        }
+        data = nullptr;
+        size = 0;
+    }
+#endif
+};
+
+// draws a .mesh file while it is still being uploaded
+//
+// every frame update copies up to budget bytes straight from the mapping into one staging
+// buffer and records the copies into device local vertex and index buffers. chunks become
+// drawable in file order once their indices and the vertices below their vertex_end are
+// in, and draw covers the resident prefix with a single indexed draw
+struct MeshStreamer
+{
+    struct PushData
+    {
+        V4 scale;
+        V4 offset;
+    };
+
+    struct Stats
+    {
+        u32 resident_chunks {0};
+        u64 uploaded {0};       // bytes, vertices and indices
+        u64 frame_uploaded {0};
+        u32 frames {0};         // frames that uploaded something
+        float first_draw_ms {0.f};
+        float load_ms {0.f};    // from init until everything was resident
+    };
+
+    using Clock = std::chrono::high_resolution_clock;
+
+    Context* context {nullptr};
+
+    MappedFile file;
+    const MeshHeader* header {nullptr};
+    const MeshChunk* chunks {nullptr};
+
+    Buffer vertices;
+    Buffer indices;
+    Buffer staging;
+    u64 budget {0};
+
+    u64 vertex_cursor {0}; // vertices uploaded
+    u64 index_cursor {0};  // indices uploaded
+    bool damaged {false};  // an index past its chunk's vertex_end, nothing more is streamed
+
+    Clock::time_point start;
+
+    VkDescriptorSetLayout set_layout;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet set;
+    u32 pipeline;
+
+    Stats stats;
+
+    bool resident()
+    {
+        return header && stats.resident_chunks == header->chunk_count;
+    }
+
+    u64 file_size()
+    {
+        return header ? header->file_size : 0;
+    }
+
+    // false when the file can't be mapped, isn't a mesh file or its chunk table is damaged
+    bool init(Context& c, const char* path, const u64 frame_budget = 8 << 20)
+    {
+        VkResult err;
+
+        context = &c;
+        start = Clock::now();
+
+        if(!file.open(path)){
+            return false;
+        }
+
+        header = mesh_header(file.data, file.size);
+        if(!header || !header->chunk_count)
+        {
+            header = nullptr;
+            file.close();
+            return false;
+        }
+        chunks = (const MeshChunk*)(file.data + header->chunk_offset);
+
+        // a chunk never takes more than its own size, bigger ones are spread over frames
+        budget = std::max<u64>(frame_budget, sizeof(MeshVertex));
+
+        vertices = c.create_buffer(std::max<u64>(header->vertex_count, 1) * sizeof(MeshVertex),
+                                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        indices = c.create_buffer(std::max<u64>(header->index_count, 1) * sizeof(u32),
+                                  VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        staging = c.create_buffer(budget, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        {
+            VkDescriptorSetLayoutBinding binding
+            {
+                .binding = 0,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+            };
+
+            VkDescriptorSetLayoutCreateInfo info
+            {
+                .sType = VKT(DESCRIPTOR_SET_LAYOUT_CREATE_INFO),
+                .bindingCount = 1,
+                .pBindings = &binding,
+            };
+            err = vkCreateDescriptorSetLayout(c.gpu->device, &info, nullptr, &set_layout);
+            check_vk(err);
+        }
+
+        {
+            VkDescriptorPoolSize size
+            {
+                .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+            };
+
+            VkDescriptorPoolCreateInfo info
+            {
+                .sType = VKT(DESCRIPTOR_POOL_CREATE_INFO),
+                .maxSets = 1,
+                .poolSizeCount = 1,
+                .pPoolSizes = &size,
+            };
+            err = vkCreateDescriptorPool(c.gpu->device, &info, nullptr, &descriptor_pool);
+            check_vk(err);
+
+            VkDescriptorSetAllocateInfo allocate_info
+            {
+                .sType = VKT(DESCRIPTOR_SET_ALLOCATE_INFO),
+                .descriptorPool = descriptor_pool,
+                .descriptorSetCount = 1,
+                .pSetLayouts = &set_layout,
+            };
+            err = vkAllocateDescriptorSets(c.gpu->device, &allocate_info, &set);
+            check_vk(err);
+        }
+
+        {
+            VkDescriptorBufferInfo buffer {.buffer = vertices.buffer, .offset = 0, .range = VK_WHOLE_SIZE};
+
+            VkWriteDescriptorSet write
+            {
+                .sType = VKT(WRITE_DESCRIPTOR_SET),
+                .dstSet = set,
+                .dstBinding = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &buffer,
+            };
+            vkUpdateDescriptorSets(c.gpu->device, 1, &write, 0, nullptr);
+        }
+
+        pipeline = c.add_new_pipeline([&c, this]() -> Pipeline
+        {
+            Pipeline result;
+            VkResult err;
+            auto info {c.new_pipeline_create_info()};
+
+            auto vertex {c.load_shader("mesh.vert.spv")};
+
+            const auto shader_count {2};
+
+            info.stageCount = shader_count;
+
+            VkPipelineShaderStageCreateInfo shader_stages[shader_count] {};
+
+            shader_stages[0] = c.new_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vertex);
+            shader_stages[1] = c.new_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, c.use_generic_fragment());
+            info.pStages = shader_stages;
+
+            VkPushConstantRange constant
+            {
+                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+                .offset = 0,
+                .size = sizeof(PushData),
+            };
+
+            VkPipelineLayoutCreateInfo layout_info
+            {
+                .sType = VKT(PIPELINE_LAYOUT_CREATE_INFO),
+                .setLayoutCount = 1,
+                .pSetLayouts = &set_layout,
+                .pushConstantRangeCount = 1,
+                .pPushConstantRanges = &constant,
+            };
+
+            err = vkCreatePipelineLayout(c.gpu->device, &layout_info, nullptr, &result.layout);
+            check_vk(err);
+
+            info.layout = result.layout;
+            err = vkCreateGraphicsPipelines(c.gpu->device, VK_NULL_HANDLE, 1, &info, nullptr, &result.pipeline);
+            check_vk(err);
+            vkDestroyShaderModule(c.gpu->device, vertex, nullptr);
+            return result;
+        });
+
+        return true;
+    }
+
+    // between Context::begin_frame and begin_render_pass, the fence wait there means the
+    // copies of the last frame are done and staging can be written again
+    void update(VkCommandBuffer cmd)
+    {
+        stats.frame_uploaded = 0;
+        if(!header || resident() || damaged){
+            return;
+        }
+
+        const auto resident_before {stats.resident_chunks};
+        auto* out {(u8*)staging.data};
+        u64 used {0};
+        Array<VkBufferCopy> vertex_copies;
+        Array<VkBufferCopy> index_copies;
+
+        auto copy {[&](const u64 file_offset, const u64 count, const u64 stride, u64& cursor, Array<VkBufferCopy>& copies)
+        {
+            const auto n {std::min(count, (budget - used) / stride)};
+            if(!n){
+                return false;
+            }
+
+            // the only read of the mapping, pages fault in here
+            memcpy(out + used, file.data + file_offset + cursor * stride, n * stride);
+            copies.push_back({.srcOffset = used, .dstOffset = cursor * stride, .size = n * stride});
+            used += n * stride;
+            cursor += n;
+            return n == count;
+        }};
+
+        while(!resident())
+        {
+            const auto& chunk {chunks[stats.resident_chunks]};
+
+            if(vertex_cursor < chunk.vertex_end &&
+               !copy(header->vertex_offset, chunk.vertex_end - vertex_cursor, sizeof(MeshVertex), vertex_cursor, vertex_copies)){
+                break;
+            }
+
+            const u64 index_end {(u64)chunk.index_first + chunk.index_count};
+            if(index_cursor < index_end)
+            {
+                const auto first {index_cursor};
+                const auto* staged {(const u32*)(out + used)};
+                const auto complete {copy(header->index_offset, index_end - index_cursor, sizeof(u32), index_cursor, index_copies)};
+
+                // the header only checks the chunk table, the values are checked here as they
+                // go up, the draw would read vertices that aren't uploaded or past the buffer
+                auto valid {true};
+                for(u64 i = 0; i < index_cursor - first; i++){
+                    valid = valid && staged[i] < chunk.vertex_end;
+                }
+                if(!valid)
+                {
+                    fprintf(stderr, "mesh: chunk %u indexes past its vertices, streaming stopped\n", stats.resident_chunks);
+                    index_copies.pop_back();
+                    index_cursor = first;
+                    damaged = true;
+                    break;
+                }
+
+                if(!complete){
+                    break;
+                }
+            }
+
+            stats.resident_chunks++;
+        }
+
+        // before the early out, a chunk can become resident without copying anything. the first
+        // upload may not finish a chunk, drawing starts with the first resident one
+        const auto ms {std::chrono::duration<float, std::milli>{Clock::now() - start}.count()};
+        if(resident_before == 0 && stats.resident_chunks){
+            stats.first_draw_ms = ms;
+        }
+        if(resident()){
+            stats.load_ms = ms;
+        }
+
+        if(!used){
+            return;
+        }
+
+        if(!vertex_copies.empty()){
+            vkCmdCopyBuffer(cmd, staging.buffer, vertices.buffer, vertex_copies.size(), vertex_copies.data());
+        }
+        if(!index_copies.empty()){
+            vkCmdCopyBuffer(cmd, staging.buffer, indices.buffer, index_copies.size(), index_copies.data());
+        }
+
+        VkMemoryBarrier barrier
+        {
+            .sType = VKT(MEMORY_BARRIER),
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+        };
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+                             1, &barrier, 0, nullptr, 0, nullptr);
+
+        stats.uploaded += used;
+        stats.frame_uploaded = used;
+        stats.frames++;
+    }
+
+    // x and y of the bounds are fit into the window area, keeping the aspect, z goes to depth
+    void draw(VkCommandBuffer cmd)
+    {
+        if(!header || !stats.resident_chunks){
+            return;
+        }
+
+        const auto* lo {header->bounds_min};
+        const auto* hi {header->bounds_max};
+        const auto w {fmaxf(hi[0] - lo[0], 1e-6f)};
+        const auto h {fmaxf(hi[1] - lo[1], 1e-6f)};
+        const auto d {fmaxf(hi[2] - lo[2], 1e-6f)};
+
+        const auto pixels {0.9f * fminf(context->width / w, context->height / h)};
+        const V2 corner {(context->width - w * pixels) * 0.5f, (context->height - h * pixels) * 0.5f};
+        const auto p0 {context->norm(corner.x, corner.y)};
+        const auto p1 {context->norm(corner.x + w * pixels, corner.y + h * pixels)};
+
+        PushData data;
+        data.scale = {(p1.x - p0.x) / w, (p1.y - p0.y) / h, -1.f / d, 0.f};
+        data.offset = {p0.x - lo[0] * data.scale.x, p0.y - lo[1] * data.scale.y, hi[2] / d, 0.f};
+
+        const auto& last {chunks[stats.resident_chunks - 1]};
+
+        const auto& pl {context->get_pipeline(pipeline)};
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pl.pipeline);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pl.layout, 0, 1, &set, 0, nullptr);
+        vkCmdPushConstants(cmd, pl.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(data), &data);
+        vkCmdBindIndexBuffer(cmd, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdDrawIndexed(cmd, last.index_first + last.index_count, 1, 0, 0, 0);
+    }
+
+    void destroy()
+    {
+        const auto device {context->gpu->device};
+        vkDeviceWaitIdle(device);
+
+        for(auto* b : {&vertices, &indices, &staging}){
+            context->destroy_buffer(*b);
+        }
+        vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+        vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+
+        file.close();
+        header = nullptr;
+    }
+};
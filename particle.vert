@@ -0,0 +1,33 @@
+#version 450
+
+struct Particle
+{
+    vec2 position;
+    vec2 velocity;
+    float age;
+    float life;
+    float size;
+    uint color;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Particles { Particle particles[]; };
+
+layout(push_constant) uniform Data
+{
+    vec4 transform; // pixels to ndc, xy scale, zw offset
+};
+
+layout(location = 0) out vec4 color;
+
+const vec2 corners[6] = vec2[](vec2(-1, -1), vec2(1, -1), vec2(1, 1), vec2(-1, -1), vec2(1, 1), vec2(-1, 1));
+
+void main()
+{
+    Particle p = particles[gl_InstanceIndex];
+
+    vec2 position = p.position + corners[gl_VertexIndex] * p.size;
+    gl_Position = vec4(position * transform.xy + transform.zw, 0.0, 1.0);
+
+    color = unpackUnorm4x8(p.color);
+    color.a *= 1.0 - p.age / p.life;
+}
@@ -0,0 +1,445 @@
+#pragma once
+
+#include <cstring>
+
+#include "context.hpp"
+#include "utilities.hpp"
+
+// matches Particle in the particle shaders, positions in window pixels
+struct Particle
+{
+    V2 position;
+    V2 velocity;
+    float age;
+    float life;
+    float size;
+    u32 color; // rgba8
+};
+
+// counters and indirect arguments, written by the gpu only
+struct ParticleState
+{
+    u32 count[2]; // alive in each particle buffer
+    u32 pad[2];
+    u32 draw[4];     // VkDrawIndirectCommand
+    u32 dispatch[3]; // VkDispatchIndirectCommand, simulation groups for the next frame
+    u32 pad2;
+};
+
+// particles that never leave the device
+//
+// two particle buffers take turns as source and target. every frame one compute pass
+// ages and moves the source particles and appends the survivors to the target, so dead
+// ones are compacted away, a second appends the newly spawned, and a one thread pass
+// clamps the count and writes the indirect arguments for the draw and for the next
+// frame's simulation. the draw is an instanced quad per particle straight from the
+// target, blended additively so the order the atomics hand out doesn't show
+struct ParticleSystem
+{
+    struct SimulateData
+    {
+        V4 emitter; // x, y in pixels, spread in radians, speed in pixels per second
+        float dt;
+        float gravity;
+        float drag;
+        float time;
+        u32 source;
+        u32 spawn;
+        u32 capacity;
+        u32 seed;
+    };
+
+    struct DrawData
+    {
+        V4 transform; // pixels to ndc, xy scale, zw offset
+    };
+
+    struct Stats
+    {
+        u32 alive {0};         // a frame late, copied back for statistics only
+        u32 spawned {0};       // asked for this frame
+        float gpu_ms {0.f};    // spawn, simulation and compaction, a frame late
+        bool timed {false};
+    };
+
+    static constexpr u32 group_size {64};
+
+    Context* context {nullptr};
+
+    Buffer particles[2];
+    Buffer state;
+    Buffer readback; // alive count for stats, host visible
+
+    u32 capacity {0};
+    u32 source {0};   // buffer the last frame wrote
+    u64 frame {0};
+    float time {0.f};
+
+    float gravity {300.f};
+    float drag {0.4f};
+
+    VkDescriptorSetLayout set_layout;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet sets[2]; // binding 0 reads particles[i], binding 1 writes particles[i ^ 1]
+
+    u32 simulate_pipeline;
+    u32 emit_pipeline;
+    u32 finalize_pipeline;
+    u32 draw_pipeline;
+
+    VkQueryPool timestamps {VK_NULL_HANDLE};
+    bool timestamps_pending {false};
+
+    Stats stats;
+
+    void init(Context& c, const u32 max_particles)
+    {
+        VkResult err;
+
+        context = &c;
+        capacity = max_particles;
+
+        for(auto& p : particles)
+        {
+            p = c.create_buffer(sizeof(Particle) * capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+
+        state = c.create_buffer(sizeof(ParticleState),
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        readback = c.create_buffer(sizeof(u32), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        memset(readback.data, 0, sizeof(u32));
+
+        if(c.gpu->properties.limits.timestampComputeAndGraphics)
+        {
+            VkQueryPoolCreateInfo info
+            {
+                .sType = VKT(QUERY_POOL_CREATE_INFO),
+                .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                .queryCount = 2,
+            };
+            err = vkCreateQueryPool(c.gpu->device, &info, nullptr, &timestamps);
+            check_vk(err);
+        }
+
+        {
+            VkDescriptorSetLayoutBinding bindings[3] {};
+            for(u32 i = 0; i < array_size(bindings); i++)
+            {
+                bindings[i].binding = i;
+                bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                bindings[i].descriptorCount = 1;
+                bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            }
+            bindings[1].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+            VkDescriptorSetLayoutCreateInfo info
+            {
+                .sType = VKT(DESCRIPTOR_SET_LAYOUT_CREATE_INFO),
+                .bindingCount = array_size(bindings),
+                .pBindings = bindings,
+            };
+            err = vkCreateDescriptorSetLayout(c.gpu->device, &info, nullptr, &set_layout);
+            check_vk(err);
+        }
+
+        {
+            VkDescriptorPoolSize size
+            {
+                .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 6,
+            };
+
+            VkDescriptorPoolCreateInfo info
+            {
+                .sType = VKT(DESCRIPTOR_POOL_CREATE_INFO),
+                .maxSets = 2,
+                .poolSizeCount = 1,
+                .pPoolSizes = &size,
+            };
+            err = vkCreateDescriptorPool(c.gpu->device, &info, nullptr, &descriptor_pool);
+            check_vk(err);
+
+            const VkDescriptorSetLayout layouts[2] {set_layout, set_layout};
+            VkDescriptorSetAllocateInfo allocate_info
+            {
+                .sType = VKT(DESCRIPTOR_SET_ALLOCATE_INFO),
+                .descriptorPool = descriptor_pool,
+                .descriptorSetCount = 2,
+                .pSetLayouts = layouts,
+            };
+            err = vkAllocateDescriptorSets(c.gpu->device, &allocate_info, sets);
+            check_vk(err);
+        }
+
+        for(u32 s = 0; s < 2; s++)
+        {
+            VkDescriptorBufferInfo buffers[3]
+            {
+                {.buffer = particles[s].buffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                {.buffer = particles[s ^ 1].buffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                {.buffer = state.buffer, .offset = 0, .range = VK_WHOLE_SIZE},
+            };
+
+            VkWriteDescriptorSet writes[3] {};
+            for(u32 i = 0; i < array_size(writes); i++)
+            {
+                writes[i].sType = VKT(WRITE_DESCRIPTOR_SET);
+                writes[i].dstSet = sets[s];
+                writes[i].dstBinding = i;
+                writes[i].descriptorCount = 1;
+                writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                writes[i].pBufferInfo = &buffers[i];
+            }
+            vkUpdateDescriptorSets(c.gpu->device, array_size(writes), writes, 0, nullptr);
+        }
+
+        auto compute_pipeline {[&](const char* shader)
+        {
+            return c.add_new_compute_pipeline([&c, this, shader]() -> Pipeline
+            {
+                Pipeline result;
+                VkResult err;
+
+                auto compute {c.load_shader(shader)};
+
+                VkPushConstantRange constant
+                {
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .offset = 0,
+                    .size = sizeof(SimulateData),
+                };
+
+                VkPipelineLayoutCreateInfo layout_info
+                {
+                    .sType = VKT(PIPELINE_LAYOUT_CREATE_INFO),
+                    .setLayoutCount = 1,
+                    .pSetLayouts = &set_layout,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &constant,
+                };
+
+                err = vkCreatePipelineLayout(c.gpu->device, &layout_info, nullptr, &result.layout);
+                check_vk(err);
+
+                auto info {c.new_compute_pipeline_create_info(compute)};
+                info.layout = result.layout;
+                err = vkCreateComputePipelines(c.gpu->device, VK_NULL_HANDLE, 1, &info, nullptr, &result.pipeline);
+                check_vk(err);
+                vkDestroyShaderModule(c.gpu->device, compute, nullptr);
+                return result;
+            });
+        }};
+
+        simulate_pipeline = compute_pipeline("particle_simulate.comp.spv");
+        emit_pipeline = compute_pipeline("particle_emit.comp.spv");
+        finalize_pipeline = compute_pipeline("particle_finalize.comp.spv");
+
+        draw_pipeline = c.add_new_pipeline([&c, this]() -> Pipeline
+        {
+            Pipeline result;
+            VkResult err;
+            auto info {c.new_pipeline_create_info()};
+
+            // additive, so the result doesn't depend on the order particles were compacted in
+            auto attachment {c.color_blend_attachment};
+            attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+            auto blend {c.color_blend_info};
+            blend.pAttachments = &attachment;
+            info.pColorBlendState = &blend;
+
+            if(c.depth_enabled){
+                info.pDepthStencilState = &c.blend_depth_stencil_info;
+            }
+
+            auto vertex {c.load_shader("particle.vert.spv")};
+
+            const auto shader_count {2};
+
+            info.stageCount = shader_count;
+
+            VkPipelineShaderStageCreateInfo shader_stages[shader_count] {};
+
+            shader_stages[0] = c.new_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vertex);
+            shader_stages[1] = c.new_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, c.use_generic_fragment());
+            info.pStages = shader_stages;
+
+            VkPushConstantRange constant
+            {
+                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+                .offset = 0,
+                .size = sizeof(DrawData),
+            };
+
+            VkPipelineLayoutCreateInfo layout_info
+            {
+                .sType = VKT(PIPELINE_LAYOUT_CREATE_INFO),
+                .setLayoutCount = 1,
+                .pSetLayouts = &set_layout,
+                .pushConstantRangeCount = 1,
+                .pPushConstantRanges = &constant,
+            };
+
+            err = vkCreatePipelineLayout(c.gpu->device, &layout_info, nullptr, &result.layout);
+            check_vk(err);
+
+            info.layout = result.layout;
+            err = vkCreateGraphicsPipelines(c.gpu->device, VK_NULL_HANDLE, 1, &info, nullptr, &result.pipeline);
+            check_vk(err);
+            vkDestroyShaderModule(c.gpu->device, vertex, nullptr);
+            return result;
+        });
+    }
+
+    static void compute_barrier(VkCommandBuffer cmd, const VkPipelineStageFlags dst_stages, const VkAccessFlags dst_access)
+    {
+        VkMemoryBarrier barrier
+        {
+            .sType = VKT(MEMORY_BARRIER),
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = dst_access,
+        };
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dst_stages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // between Context::begin_frame and begin_render_pass. emitter in window pixels
+    void update(VkCommandBuffer cmd, const float dt, const V2 emitter, const u32 spawn, const float spread = 0.8f, const float speed = 400.f)
+    {
+        auto& c {*context};
+
+        // the fence in begin_frame means last frame's copy and timestamps are done
+        stats.alive = *(const u32*)readback.data;
+        stats.spawned = spawn;
+        if(timestamps_pending)
+        {
+            u64 ticks[2];
+            const auto err {vkGetQueryPoolResults(c.gpu->device, timestamps, 0, 2, sizeof(ticks), ticks, sizeof(u64), VK_QUERY_RESULT_64_BIT)};
+            if(err == VK_SUCCESS)
+            {
+                stats.gpu_ms = (ticks[1] - ticks[0]) * c.gpu->properties.limits.timestampPeriod * 1e-6f;
+                stats.timed = true;
+            }
+        }
+
+        if(timestamps)
+        {
+            vkCmdResetQueryPool(cmd, timestamps, 0, 2);
+            vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamps, 0);
+            timestamps_pending = true;
+        }
+
+        if(frame == 0)
+        {
+            ParticleState initial {};
+            initial.draw[0] = 6;
+            initial.dispatch[1] = 1;
+            initial.dispatch[2] = 1;
+            vkCmdUpdateBuffer(cmd, state.buffer, 0, sizeof(initial), &initial);
+
+            VkMemoryBarrier barrier
+            {
+                .sType = VKT(MEMORY_BARRIER),
+                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+            };
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                                 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+
+        time += dt;
+        frame++;
+
+        const SimulateData data
+        {
+            .emitter = {emitter.x, emitter.y, spread, speed},
+            .dt = dt,
+            .gravity = gravity,
+            .drag = drag,
+            .time = time,
+            .source = source,
+            .spawn = spawn,
+            .capacity = capacity,
+            .seed = (u32)frame * 0x9e3779b9u,
+        };
+
+        auto bind {[&](const u32 id)
+        {
+            const auto& pl {c.get_compute_pipeline(id)};
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pl.pipeline);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pl.layout, 0, 1, &sets[source], 0, nullptr);
+            vkCmdPushConstants(cmd, pl.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(data), &data);
+        }};
+
+        // group count for the live particles was written by last frame's finalize
+        bind(simulate_pipeline);
+        vkCmdDispatchIndirect(cmd, state.buffer, offsetof(ParticleState, dispatch));
+        compute_barrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+        if(spawn)
+        {
+            bind(emit_pipeline);
+            vkCmdDispatch(cmd, (spawn + group_size - 1) / group_size, 1, 1);
+            compute_barrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        }
+
+        bind(finalize_pipeline);
+        vkCmdDispatch(cmd, 1, 1, 1);
+
+        if(timestamps){
+            vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestamps, 1);
+        }
+
+        compute_barrier(cmd, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+
+        source ^= 1;
+
+        const VkBufferCopy region {.srcOffset = sizeof(u32) * source, .dstOffset = 0, .size = sizeof(u32)};
+        vkCmdCopyBuffer(cmd, state.buffer, readback.buffer, 1, &region);
+
+        VkMemoryBarrier host_barrier
+        {
+            .sType = VKT(MEMORY_BARRIER),
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        };
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &host_barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // inside the render pass, after update
+    void draw(VkCommandBuffer cmd)
+    {
+        auto& c {*context};
+
+        const auto origin {c.norm(0.f, 0.f)};
+        const auto unit {c.norm(1.f, 1.f)};
+        const DrawData data {{unit.x - origin.x, unit.y - origin.y, origin.x, origin.y}};
+
+        // the set that wrote particles[source] reads the other one at binding 0
+        const auto& pl {c.get_pipeline(draw_pipeline)};
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pl.pipeline);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pl.layout, 0, 1, &sets[source ^ 1], 0, nullptr);
+        vkCmdPushConstants(cmd, pl.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(data), &data);
+        vkCmdDrawIndirect(cmd, state.buffer, offsetof(ParticleState, draw), 1, sizeof(VkDrawIndirectCommand));
+    }
+
+    void destroy()
+    {
+        auto& c {*context};
+        const auto device {c.gpu->device};
+        vkDeviceWaitIdle(device);
+
+        for(auto* b : {&particles[0], &particles[1], &state, &readback}){
+            c.destroy_buffer(*b);
+        }
+        if(timestamps){
+            vkDestroyQueryPool(device, timestamps, nullptr);
+        }
+        vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+        vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+    }
+};
@@ -0,0 +1,813 @@
+#pragma once
+
+#include <functional>
+#include <algorithm>
+#include <map>
+
+#include "context.hpp"
+
+// passes declare which images they read and write, compile() then
+//  - culls passes that don't contribute to an output
+//  - works out the layout transitions and the smallest set of barriers between passes
+//  - places transient images with disjoint lifetimes at the same offset of one allocation
+// imported images (the swapchain) are swapped every frame with set_image
+struct RenderGraph
+{
+    enum Access : u8
+    {
+        color_attachment,
+        depth_attachment,
+        transfer_src,
+        transfer_dst,
+        sampled,
+    };
+
+    struct AccessInfo
+    {
+        VkImageLayout layout;
+        VkPipelineStageFlags stages;
+        VkAccessFlags read;
+        VkAccessFlags write;
+        VkImageUsageFlags usage;
+    };
+
+    static AccessInfo access_info(const Access a)
+    {
+        switch(a)
+        {
+            case color_attachment:
+                return {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
+            case depth_attachment:
+                return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+            case transfer_src:
+                return {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_ACCESS_TRANSFER_READ_BIT, 0, VK_IMAGE_USAGE_TRANSFER_SRC_BIT};
+            case transfer_dst:
+                return {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT};
+            case sampled:
+                return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_USAGE_SAMPLED_BIT};
+        }
+        assert(false);
+        return {};
+    }
+
+    struct Resource
+    {
+        String name;
+        VkExtent2D extent;
+        VkFormat format;
+        VkImageAspectFlags aspect;
+        VkImageUsageFlags usage {0};
+
+        bool imported {false};
+        bool output {false};
+        VkImageLayout initial_layout {VK_IMAGE_LAYOUT_UNDEFINED};
+        VkPipelineStageFlags initial_stages {0}; // for imported images, e.g. the stages waiting on the acquire semaphore
+        VkImageLayout final_layout {VK_IMAGE_LAYOUT_UNDEFINED};
+
+        VkImage image {VK_NULL_HANDLE};
+        VkImageView view {VK_NULL_HANDLE};
+
+        VkMemoryRequirements requirements {};
+        VkDeviceSize offset {0};
+        int first {-1};
+        int last {-1};
+    };
+
+    struct Use
+    {
+        u32 resource;
+        Access access;
+        bool write;
+        bool clear;
+    };
+
+    struct Barrier
+    {
+        u32 resource;
+        VkImageLayout old_layout;
+        VkImageLayout new_layout;
+        VkAccessFlags src_access;
+        VkAccessFlags dst_access;
+    };
+
+    struct Pass
+    {
+        String name;
+        Array<Use> uses;
+        std::function<void(VkCommandBuffer)> execute;
+        bool side_effects {false};
+        RGBA clear_color {0, 0, 0, 1.f};
+
+        void read(const u32 resource, const Access a)
+        {
+            uses.push_back({resource, a, false, false});
+        }
+
+        void write(const u32 resource, const Access a, const bool clear = false)
+        {
+            uses.push_back({resource, a, true, clear});
+        }
+
+        // filled by compile
+        bool culled {false};
+        VkRenderPass render_pass {VK_NULL_HANDLE};
+        Array<Barrier> barriers;
+        VkPipelineStageFlags src_stages {0};
+        VkPipelineStageFlags dst_stages {0};
+        std::map<Array<VkImageView>, VkFramebuffer> framebuffers;
+    };
+
+    struct Stats
+    {
+        u32 passes {0};
+        u32 culled {0};
+        u32 barriers {0};
+        u32 barrier_calls {0};
+        VkDeviceSize transient_bytes {0}; // what separate allocations would take
+        VkDeviceSize heap_bytes {0};
+    };
+
+    Context* context {nullptr};
+
+    Array<Resource> resources;
+    Array<Pass> passes;
+
+    Array<Barrier> final_barriers;
+    VkPipelineStageFlags final_src_stages {0};
+
+    VkDeviceMemory heap {VK_NULL_HANDLE};
+
+    Stats stats;
+
+    void init(Context& c)
+    {
+        context = &c;
+    }
+
+    u32 create_image(const String& name, const VkExtent2D extent, const VkFormat format, const VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT)
+    {
+        Resource r;
+        r.name = name;
+        r.extent = extent;
+        r.format = format;
+        r.aspect = aspect;
+        resources.push_back(r);
+        return resources.size() - 1;
+    }
+
+    // final_layout is what the image is left in at the end of the frame, imported images are always outputs
+    u32 import_image(const String& name, const VkExtent2D extent, const VkFormat format, const VkImageLayout initial_layout, const VkImageLayout final_layout,
+                     const VkPipelineStageFlags initial_stages)
+    {
+        Resource r;
+        r.name = name;
+        r.extent = extent;
+        r.format = format;
+        r.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+        r.imported = true;
+        r.output = true;
+        r.initial_layout = initial_layout;
+        r.final_layout = final_layout;
+        r.initial_stages = initial_stages;
+        resources.push_back(r);
+        return resources.size() - 1;
+    }
+
+    void set_image(const u32 resource, VkImage image, VkImageView view)
+    {
+        auto& r {resources[resource]};
+        assert(r.imported);
+        r.image = image;
+        r.view = view;
+    }
+
+    // the reference is only good until the next add_pass
+    Pass& add_pass(const String& name)
+    {
+        passes.push_back({});
+        passes.back().name = name;
+        return passes.back();
+    }
+
+    Pass& get_pass(const String& name)
+    {
+        for(auto& p : passes)
+        {
+            if(p.name == name){
+                return p;
+            }
+        }
+        assert(false);
+        return passes[0];
+    }
+
+    bool is_graphics(const Pass& p)
+    {
+        for(auto& u : p.uses)
+        {
+            if(u.access == color_attachment || u.access == depth_attachment){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void cull()
+    {
+        Array<bool> needed(resources.size(), false);
+        for(u32 i = 0; i < resources.size(); i++){
+            needed[i] = resources[i].output;
+        }
+
+        for(int i = passes.size() - 1; i >= 0; i--)
+        {
+            auto& p {passes[i]};
+            auto alive {p.side_effects};
+            for(auto& u : p.uses)
+            {
+                if(u.write && needed[u.resource]){
+                    alive = true;
+                }
+            }
+            p.culled = !alive;
+            if(!alive){
+                continue;
+            }
+            for(auto& u : p.uses)
+            {
+                // attachments that aren't cleared are loaded, so they depend on earlier writers too
+                if(!u.write || (!u.clear && (u.access == color_attachment || u.access == depth_attachment))){
+                    needed[u.resource] = true;
+                }
+            }
+        }
+    }
+
+    void allocate()
+    {
+        VkResult err;
+        auto device {context->gpu->device};
+
+        Array<u32> transient;
+        u32 type_bits {~0u};
+
+        for(u32 i = 0; i < resources.size(); i++)
+        {
+            auto& r {resources[i]};
+            if(r.imported || r.first < 0){
+                continue;
+            }
+
+            VkImageCreateInfo info
+            {
+                .sType = VKT(IMAGE_CREATE_INFO),
+                .imageType = VK_IMAGE_TYPE_2D,
+                .format = r.format,
+                .extent = {r.extent.width, r.extent.height, 1},
+                .mipLevels = 1,
+                .arrayLayers = 1,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .tiling = VK_IMAGE_TILING_OPTIMAL,
+                .usage = r.usage,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            };
+            err = vkCreateImage(device, &info, nullptr, &r.image);
+            check_vk(err);
+
+            vkGetImageMemoryRequirements(device, r.image, &r.requirements);
+            type_bits &= r.requirements.memoryTypeBits;
+            stats.transient_bytes += r.requirements.size;
+            transient.push_back(i);
+        }
+
+        if(transient.empty()){
+            return;
+        }
+
+        auto lifetimes_overlap {[&](const Resource& a, const Resource& b)
+        {
+            return a.first <= b.last && b.first <= a.last;
+        }};
+
+        // biggest first, each image goes to the lowest offset that doesn't collide with
+        // an already placed image that is alive at the same time
+        std::sort(transient.begin(), transient.end(), [&](u32 a, u32 b)
+        {
+            return resources[a].requirements.size > resources[b].requirements.size;
+        });
+
+        Array<u32> placed;
+        VkDeviceSize heap_size {0};
+
+        for(auto i : transient)
+        {
+            auto& r {resources[i]};
+            const auto align {r.requirements.alignment};
+
+            Array<VkDeviceSize> candidates {0};
+            for(auto j : placed)
+            {
+                auto& o {resources[j]};
+                if(lifetimes_overlap(r, o)){
+                    candidates.push_back(o.offset + o.requirements.size);
+                }
+            }
+            std::sort(candidates.begin(), candidates.end());
+
+            for(auto c : candidates)
+            {
+                const auto offset {(c + align - 1) / align * align};
+                auto fits {true};
+                for(auto j : placed)
+                {
+                    auto& o {resources[j]};
+                    if(lifetimes_overlap(r, o) && offset < o.offset + o.requirements.size && o.offset < offset + r.requirements.size)
+                    {
+                        fits = false;
+                        break;
+                    }
+                }
+                if(fits)
+                {
+                    r.offset = offset;
+                    break;
+                }
+            }
+
+            heap_size = std::max(heap_size, r.offset + r.requirements.size);
+            placed.push_back(i);
+        }
+
+        stats.heap_bytes = heap_size;
+
+        VkMemoryAllocateInfo allocate_info
+        {
+            .sType = VKT(MEMORY_ALLOCATE_INFO),
+            .allocationSize = heap_size,
+            .memoryTypeIndex = context->find_memory_type(type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+        };
+        err = vkAllocateMemory(device, &allocate_info, nullptr, &heap);
+        check_vk(err);
+        context->memory.track(heap, MemoryTelemetry::attachments, allocate_info.memoryTypeIndex, heap_size);
+
+        for(auto i : transient)
+        {
+            auto& r {resources[i]};
+            err = vkBindImageMemory(device, r.image, heap, r.offset);
+            check_vk(err);
+
+            VkImageViewCreateInfo view_info
+            {
+                .sType = VKT(IMAGE_VIEW_CREATE_INFO),
+                .image = r.image,
+                .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                .format = r.format,
+                .subresourceRange = {
+                                      .aspectMask = r.aspect,
+                                      .baseMipLevel = 0,
+                                      .levelCount = 1,
+                                      .baseArrayLayer = 0,
+                                      .layerCount = 1}
+            };
+            err = vkCreateImageView(device, &view_info, nullptr, &r.view);
+            check_vk(err);
+        }
+    }
+
+    void build_barriers()
+    {
+        struct State
+        {
+            VkImageLayout layout;
+            VkPipelineStageFlags stages;
+            VkAccessFlags write; // pending writes that later accesses have to wait on
+            bool read;
+        };
+
+        Array<State> states(resources.size());
+        for(u32 i = 0; i < resources.size(); i++){
+            states[i] = {resources[i].initial_layout, resources[i].initial_stages, 0, false};
+        }
+
+        // the first use of an aliased image has to wait for whatever lived in its memory before
+        auto alias_predecessors {[&](const u32 i, VkPipelineStageFlags& stages, VkAccessFlags& access)
+        {
+            auto& r {resources[i]};
+            for(u32 j = 0; j < resources.size(); j++)
+            {
+                auto& o {resources[j]};
+                if(j == i || o.imported || o.first < 0 || o.last >= r.first){
+                    continue;
+                }
+                if(r.offset < o.offset + o.requirements.size && o.offset < r.offset + r.requirements.size)
+                {
+                    stages |= states[j].stages;
+                    access |= states[j].write;
+                }
+            }
+        }};
+
+        for(int p = 0; p < (int)passes.size(); p++)
+        {
+            auto& pass {passes[p]};
+            if(pass.culled){
+                continue;
+            }
+
+            for(auto& u : pass.uses)
+            {
+                auto& r {resources[u.resource]};
+                auto& s {states[u.resource]};
+                const auto info {access_info(u.access)};
+
+                VkImageLayout old_layout {s.layout};
+                VkPipelineStageFlags src_stages {s.stages};
+                VkAccessFlags src_access {s.write};
+
+                if(!r.imported && r.first == p)
+                {
+                    // contents from an earlier frame or another alias are never kept
+                    old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+                    src_stages = 0;
+                    src_access = 0;
+                    alias_predecessors(u.resource, src_stages, src_access);
+                }
+
+                const auto layout_change {old_layout != info.layout};
+                const auto after_write {src_access != 0};
+                const auto write_after_read {u.write && s.read};
+
+                // read after read in the same layout needs nothing
+                if(layout_change || after_write || write_after_read)
+                {
+                    pass.barriers.push_back({u.resource, old_layout, info.layout, src_access,
+                                             (u.write ? info.write : 0) | info.read});
+                    pass.src_stages |= src_stages ? src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+                    pass.dst_stages |= info.stages;
+                }
+
+                if(u.write)
+                {
+                    s = {info.layout, info.stages, info.write, false};
+                }
+                else
+                {
+                    if(s.read && s.layout == info.layout){
+                        s.stages |= info.stages;
+                    }
+                    else{
+                        s.stages = info.stages;
+                    }
+                    s.layout = info.layout;
+                    s.write = 0;
+                    s.read = true;
+                }
+            }
+        }
+
+        for(u32 i = 0; i < resources.size(); i++)
+        {
+            auto& r {resources[i]};
+            if(!r.imported || r.first < 0 || states[i].layout == r.final_layout){
+                continue;
+            }
+            final_barriers.push_back({i, states[i].layout, r.final_layout, states[i].write, 0});
+            final_src_stages |= states[i].stages;
+        }
+    }
+
+    void build_render_passes()
+    {
+        VkResult err;
+
+        for(int p = 0; p < (int)passes.size(); p++)
+        {
+            auto& pass {passes[p]};
+            if(pass.culled || !is_graphics(pass)){
+                continue;
+            }
+
+            Array<VkAttachmentDescription> attachments;
+            Array<VkAttachmentReference> colors;
+            VkAttachmentReference depth {};
+            auto has_depth {false};
+
+            for(auto& u : pass.uses)
+            {
+                if(u.access != color_attachment && u.access != depth_attachment){
+                    continue;
+                }
+                auto& r {resources[u.resource]};
+                const auto info {access_info(u.access)};
+
+                // results nobody reads afterwards are not stored
+                const auto store {r.output || r.last > p};
+                const auto fresh {!r.imported && r.first == p};
+
+                VkAttachmentDescription ad
+                {
+                    .format = r.format,
+                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                    .loadOp = u.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : fresh ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD,
+                    .storeOp = store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                    .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                    .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                    .initialLayout = info.layout,
+                    .finalLayout = info.layout,
+                };
+
+                VkAttachmentReference ref {(u32)attachments.size(), info.layout};
+                attachments.push_back(ad);
+                if(u.access == color_attachment){
+                    colors.push_back(ref);
+                }
+                else
+                {
+                    depth = ref;
+                    has_depth = true;
+                }
+            }
+
+            VkSubpassDescription sp
+            {
+                .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+                .colorAttachmentCount = (u32)colors.size(),
+                .pColorAttachments = colors.data(),
+                .pDepthStencilAttachment = has_depth ? &depth : nullptr,
+            };
+
+            VkRenderPassCreateInfo info
+            {
+                .sType = VKT(RENDER_PASS_CREATE_INFO),
+                .attachmentCount = (u32)attachments.size(),
+                .pAttachments = attachments.data(),
+                .subpassCount = 1,
+                .pSubpasses = &sp,
+            };
+
+            err = vkCreateRenderPass(context->gpu->device, &info, nullptr, &pass.render_pass);
+            check_vk(err);
+        }
+    }
+
+    void compile()
+    {
+        stats = {};
+
+        cull();
+
+        for(int p = 0; p < (int)passes.size(); p++)
+        {
+            auto& pass {passes[p]};
+            stats.passes++;
+            if(pass.culled)
+            {
+                stats.culled++;
+                continue;
+            }
+            for(auto& u : pass.uses)
+            {
+                auto& r {resources[u.resource]};
+                r.usage |= access_info(u.access).usage;
+                if(r.first < 0){
+                    r.first = p;
+                }
+                r.last = p;
+            }
+        }
+
+        allocate();
+        build_barriers();
+        build_render_passes();
+    }
+
+    void emit_barriers(VkCommandBuffer cmd, const Array<Barrier>& barriers, VkPipelineStageFlags src, VkPipelineStageFlags dst)
+    {
+        if(barriers.empty()){
+            return;
+        }
+
+        Array<VkImageMemoryBarrier> image_barriers;
+        image_barriers.reserve(barriers.size());
+        for(auto& b : barriers)
+        {
+            auto& r {resources[b.resource]};
+            image_barriers.push_back({
+                .sType = VKT(IMAGE_MEMORY_BARRIER),
+                .srcAccessMask = b.src_access,
+                .dstAccessMask = b.dst_access,
+                .oldLayout = b.old_layout,
+                .newLayout = b.new_layout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = r.image,
+                .subresourceRange = {
+                                      .aspectMask = r.aspect,
+                                      .baseMipLevel = 0,
+                                      .levelCount = 1,
+                                      .baseArrayLayer = 0,
+                                      .layerCount = 1},
+            });
+        }
+
+        vkCmdPipelineBarrier(cmd, src, dst, 0, 0, nullptr, 0, nullptr, image_barriers.size(), image_barriers.data());
+        stats.barriers += barriers.size();
+        stats.barrier_calls++;
+    }
+
+    void execute(VkCommandBuffer cmd)
+    {
+        stats.barriers = 0;
+        stats.barrier_calls = 0;
+
+        for(auto& pass : passes)
+        {
+            if(pass.culled){
+                continue;
+            }
+
+            emit_barriers(cmd, pass.barriers, pass.src_stages, pass.dst_stages);
+
+            if(!pass.render_pass)
+            {
+                pass.execute(cmd);
+                continue;
+            }
+
+            Array<VkImageView> views;
+            Array<VkClearValue> clears;
+            VkExtent2D extent {};
+            for(auto& u : pass.uses)
+            {
+                if(u.access != color_attachment && u.access != depth_attachment){
+                    continue;
+                }
+                auto& r {resources[u.resource]};
+                views.push_back(r.view);
+                extent = r.extent;
+
+                VkClearValue clear {};
+                if(u.access == color_attachment){
+                    clear.color = {{pass.clear_color.r, pass.clear_color.g, pass.clear_color.b, pass.clear_color.a}};
+                }
+                else{
+                    clear.depthStencil = {1.f, 0};
+                }
+                clears.push_back(clear);
+            }
+
+            auto& framebuffer {pass.framebuffers[views]};
+            if(!framebuffer)
+            {
+                VkFramebufferCreateInfo info
+                {
+                    .sType = VKT(FRAMEBUFFER_CREATE_INFO),
+                    .renderPass = pass.render_pass,
+                    .attachmentCount = (u32)views.size(),
+                    .pAttachments = views.data(),
+                    .width = extent.width,
+                    .height = extent.height,
+                    .layers = 1,
+                };
+                auto err {vkCreateFramebuffer(context->gpu->device, &info, nullptr, &framebuffer)};
+                check_vk(err);
+            }
+
+            VkRenderPassBeginInfo begin
+            {
+                .sType = VKT(RENDER_PASS_BEGIN_INFO),
+                .renderPass = pass.render_pass,
+                .framebuffer = framebuffer,
+                .renderArea {.offset = {0, 0}, .extent = extent},
+                .clearValueCount = (u32)clears.size(),
+                .pClearValues = clears.data(),
+            };
+
+            vkCmdBeginRenderPass(cmd, &begin, VK_SUBPASS_CONTENTS_INLINE);
+            vkCmdSetScissor(cmd, 0, 1, &begin.renderArea);
+            pass.execute(cmd);
+            vkCmdEndRenderPass(cmd);
+        }
+
+        emit_barriers(cmd, final_barriers, final_src_stages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    }
+
+    // everything compile created, imported images belong to whoever imported them
+    void destroy()
+    {
+        if(!context){
+            return;
+        }
+
+        const auto device {context->gpu->device};
+        vkDeviceWaitIdle(device);
+
+        for(auto& p : passes)
+        {
+            for(auto& [views, framebuffer] : p.framebuffers){
+                vkDestroyFramebuffer(device, framebuffer, nullptr);
+            }
+            p.framebuffers.clear();
+            if(p.render_pass){
+                vkDestroyRenderPass(device, p.render_pass, nullptr);
+            }
+            p.render_pass = VK_NULL_HANDLE;
+        }
+
+        for(auto& r : resources)
+        {
+            if(r.imported){
+                continue;
+            }
+            if(r.view){
+                vkDestroyImageView(device, r.view, nullptr);
+            }
+            if(r.image){
+                vkDestroyImage(device, r.image, nullptr);
+            }
+            r.view = VK_NULL_HANDLE;
+            r.image = VK_NULL_HANDLE;
+        }
+
+        if(heap)
+        {
+            context->memory.release(heap);
+            vkFreeMemory(device, heap, nullptr);
+            heap = VK_NULL_HANDLE;
+        }
+
+        resources.clear();
+        passes.clear();
+        final_barriers.clear();
+        stats = {};
+    }
+
+    String dump()
+    {
+        String out;
+        char line[256];
+
+        auto layout_name {[](VkImageLayout l) -> const char*
+        {
+            switch(l)
+            {
+                case VK_IMAGE_LAYOUT_UNDEFINED: return "undefined";
+                case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: return "color";
+                case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: return "depth";
+                case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return "transfer_src";
+                case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: return "transfer_dst";
+                case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return "shader_read";
+                case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return "present";
+                default: return "other";
+            }
+        }};
+
+        for(auto& p : passes)
+        {
+            snprintf(line, sizeof(line), "pass %-16s %s\n", p.name.c_str(), p.culled ? "culled" : "");
+            out += line;
+            for(auto& b : p.barriers)
+            {
+                snprintf(line, sizeof(line), "    barrier %-16s %s -> %s\n", resources[b.resource].name.c_str(),
+                         layout_name(b.old_layout), layout_name(b.new_layout));
+                out += line;
+            }
+        }
+        for(auto& b : final_barriers)
+        {
+            snprintf(line, sizeof(line), "final barrier %-16s %s -> %s\n", resources[b.resource].name.c_str(),
+                     layout_name(b.old_layout), layout_name(b.new_layout));
+            out += line;
+        }
+        for(auto& r : resources)
+        {
+            if(r.imported)
+            {
+                snprintf(line, sizeof(line), "image %-16s imported passes %d..%d\n", r.name.c_str(), r.first, r.last);
+            }
+            else if(r.first < 0)
+            {
+                snprintf(line, sizeof(line), "image %-16s unused\n", r.name.c_str());
+            }
+            else
+            {
+                snprintf(line, sizeof(line), "image %-16s %ux%u passes %d..%d offset %llu size %llu\n", r.name.c_str(),
+                         r.extent.width, r.extent.height, r.first, r.last,
+                         (unsigned long long)r.offset, (unsigned long long)r.requirements.size);
+            }
+            out += line;
+        }
+        snprintf(line, sizeof(line), "passes %u culled %u barriers %u in %u calls\ntransient %llu bytes heap %llu bytes saved %llu bytes\n",
+                 stats.passes, stats.culled, stats.barriers, stats.barrier_calls,
+                 (unsigned long long)stats.transient_bytes, (unsigned long long)stats.heap_bytes,
+                 (unsigned long long)(stats.transient_bytes - stats.heap_bytes));
+        out += line;
+        return out;
+    }
+};
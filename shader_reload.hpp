@@ -0,0 +1,327 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "context.hpp"
+#include "utilities.hpp"
+
+// recompiles shader sources when they are saved and swaps the pipelines built from them
+//
+// a worker thread waits on inotify for the source directory, compiles what changed to
+// the .spv load_shader reads, and runs the stored builders of only the pipelines that
+// loaded it. the results are handed to the context, which swaps them all in at the next
+// begin_frame and destroys the old ones a frame later, once the fence says nothing uses
+// them anymore. a source that fails to compile keeps its old pipelines
+struct ShaderReloader
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Milliseconds = std::chrono::duration<float, std::milli>;
+
+    struct Reload
+    {
+        u32 ticket;
+        String sources;
+        Clock::time_point saved;
+        float compile_ms;
+        float build_ms;
+        u32 pipelines;
+    };
+
+    struct Stats
+    {
+        u32 reloads {0};
+        u32 failures {0};            // sources that didn't compile
+        float last_latency_ms {0.f}; // save to the first frame submitted with the new pipelines
+    };
+
+    static constexpr const char* extensions[] {".vert", ".frag", ".comp", ".geom", ".tesc", ".tese"};
+
+    // wait this long after the last event before compiling, editors write in several steps
+    static constexpr int settle_ms {30};
+
+    Context* context {nullptr};
+    String directory;
+    String compiler {"glslangValidator -V"}; // followed by the source, -o and the output
+
+    std::thread worker;
+    std::atomic<bool> running {false};
+    int inotify {-1};
+
+    std::mutex mutex;
+    Array<Reload> waiting; // swapped in but not yet presented
+    u32 next_ticket {1};
+
+    Stats stats;
+
+    static bool is_shader(const String& name)
+    {
+        for(auto e : extensions)
+        {
+            const String ext {e};
+            if(name.size() > ext.size() && name.compare(name.size() - ext.size(), ext.size(), ext) == 0){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // sources in dir, the .spv files are written where load_shader looks for them
+    bool init(Context& c, const String& dir = ".")
+    {
+        context = &c;
+        directory = dir;
+
+#ifdef __linux__
+        inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        // written in place or renamed over the old file, depending on the editor
+        if(inotify < 0 || inotify_add_watch(inotify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        {
+            fprintf(stderr, "shader reload: cannot watch %s\n", dir.c_str());
+            return false;
+        }
+
+        running = true;
+        worker = std::thread {[this]{ watch(); }};
+        return true;
+#else
+        fprintf(stderr, "shader reload: needs inotify\n");
+        return false;
+#endif
+    }
+
+#ifdef __linux__
+    // names of the shader sources in the events waiting on the descriptor
+    void read_events(Array<String>& changed)
+    {
+        alignas(inotify_event) char buffer[4096];
+        while(true)
+        {
+            const auto n {read(inotify, buffer, sizeof(buffer))};
+            if(n <= 0){
+                return;
+            }
+
+            for(auto p {buffer}; p < buffer + n;)
+            {
+                const auto e {(const inotify_event*)p};
+                if(e->len)
+                {
+                    const String name {e->name};
+                    if(is_shader(name) && std::find(changed.begin(), changed.end(), name) == changed.end()){
+                        changed.push_back(name);
+                    }
+                }
+                p += sizeof(inotify_event) + e->len;
+            }
+        }
+    }
+
+    void watch()
+    {
+        while(running)
+        {
+            pollfd p {inotify, POLLIN, 0};
+            if(poll(&p, 1, 100) <= 0){
+                continue;
+            }
+
+            const auto saved {Clock::now()};
+            Array<String> changed;
+            read_events(changed);
+            while(poll(&p, 1, settle_ms) > 0){
+                read_events(changed);
+            }
+
+            if(!changed.empty()){
+                reload(changed, saved);
+            }
+        }
+    }
+#endif
+
+    // single quoted for the shell, file names can hold anything
+    static String quote(const String& s)
+    {
+        String out {"'"};
+        for(auto c : s)
+        {
+            if(c == '\''){
+                out += "'\\''";
+            }
+            else{
+                out += c;
+            }
+        }
+        return out + "'";
+    }
+
+    bool compile(const String& name)
+    {
+        const auto source {directory + "/" + name};
+        const auto command {compiler + " " + quote(source) + " -o " + quote(name + ".spv") + " 2>&1"};
+
+        auto pipe {popen(command.c_str(), "r")};
+        if(!pipe)
+        {
+            fprintf(stderr, "shader reload: cannot run %s\n", compiler.c_str());
+            return false;
+        }
+
+        String output;
+        char line[512];
+        while(fgets(line, sizeof(line), pipe)){
+            output += line;
+        }
+
+        if(pclose(pipe) != 0)
+        {
+            fprintf(stderr, "shader reload: %s failed, keeping the old pipelines\n%s", name.c_str(), output.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void reload(const Array<String>& changed, const Clock::time_point saved)
+    {
+        auto& c {*context};
+
+        Array<String> compiled;
+        for(auto& name : changed)
+        {
+            if(compile(name)){
+                compiled.push_back(name + ".spv");
+            }
+            else
+            {
+                std::lock_guard lock {mutex};
+                stats.failures++;
+            }
+        }
+        const auto t_compiled {Clock::now()};
+        if(compiled.empty()){
+            return;
+        }
+
+        // the builders read the generic fragment module from the context
+        VkShaderModule old_fragment {VK_NULL_HANDLE};
+        if(std::find(compiled.begin(), compiled.end(), Context::generic_fragment_path) != compiled.end())
+        {
+            old_fragment = c.generic_fragment_shader;
+            c.generic_fragment_shader = c.load_shader(Context::generic_fragment_path);
+        }
+
+        Array<u32> affected[2];
+        for(u32 compute = 0; compute < 2; compute++)
+        {
+            for(auto& spv : compiled)
+            {
+                for(auto id : c.pipelines_using(spv, compute))
+                {
+                    if(std::find(affected[compute].begin(), affected[compute].end(), id) == affected[compute].end()){
+                        affected[compute].push_back(id);
+                    }
+                }
+            }
+        }
+
+        const auto ticket {next_ticket++};
+        Array<Context::PipelineSwap> swaps;
+        for(u32 compute = 0; compute < 2; compute++)
+        {
+            for(auto id : affected[compute])
+            {
+                const auto p {c.rebuild_pipeline(id, compute)};
+                if(p.pipeline){
+                    swaps.push_back({id, (bool)compute, p, ticket});
+                }
+            }
+        }
+
+        if(old_fragment){
+            vkDestroyShaderModule(c.gpu->device, old_fragment, nullptr);
+        }
+
+        const auto t_built {Clock::now()};
+
+        String sources;
+        for(auto& name : compiled){
+            sources += (sources.empty() ? "" : ", ") + name.substr(0, name.size() - 4);
+        }
+
+        if(swaps.empty())
+        {
+            fprintf(stderr, "shader reload: no pipeline uses %s\n", sources.c_str());
+            return;
+        }
+
+        {
+            std::lock_guard lock {mutex};
+            waiting.push_back({ticket, sources, saved, Milliseconds{t_compiled - saved}.count(),
+                               Milliseconds{t_built - t_compiled}.count(), (u32)swaps.size()});
+        }
+        c.queue_pipeline_swaps(swaps);
+    }
+
+    // after Context::present, reports the reloads that made it into the frame just submitted
+    void end_frame()
+    {
+        const auto presented {context->presented_ticket};
+        const auto now {Clock::now()};
+
+        std::lock_guard lock {mutex};
+        auto kept {waiting.begin()};
+        for(auto& r : waiting)
+        {
+            if(r.ticket > presented)
+            {
+                *kept++ = r;
+                continue;
+            }
+
+            stats.reloads++;
+            stats.last_latency_ms = Milliseconds{now - r.saved}.count();
+            printf("shader reload %s: compiled %.1f ms, %u pipelines built in %.1f ms, first frame %.1f ms after save\n",
+                   r.sources.c_str(), r.compile_ms, r.pipelines, r.build_ms, stats.last_latency_ms);
+        }
+        waiting.erase(kept, waiting.end());
+    }
+
+    void destroy()
+    {
+        running = false;
+        if(worker.joinable()){
+            worker.join();
+        }
+
+#ifdef __linux__
+        if(inotify >= 0){
+            close(inotify);
+        }
+#endif
+        inotify = -1;
+
+        // whatever was swapped out but not yet destroyed by begin_frame, or never swapped in
+        auto& c {*context};
+        vkDeviceWaitIdle(c.gpu->device);
+        for(auto& r : c.retired_pipelines){
+            c.destroy_pipeline(r.pipeline);
+        }
+        c.retired_pipelines.clear();
+
+        std::lock_guard lock {c.swap_mutex};
+        for(auto& s : c.pending_swaps){
+            c.destroy_pipeline(s.pipeline);
+        }
+        c.pending_swaps.clear();
+    }
+};
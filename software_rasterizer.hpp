@@ -0,0 +1,565 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#include "types.hpp"
+#include "draw_queue.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// four lanes, sse2 where available, plain loops otherwise (which compilers vectorize for neon)
+struct F4
+{
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128 v;
+
+    static F4 set(const float a)                                     { return {_mm_set1_ps(a)}; }
+    static F4 set(const float a, const float b, const float c, const float d) { return {_mm_setr_ps(a, b, c, d)}; }
+
+    F4 operator + (const F4& o) const { return {_mm_add_ps(v, o.v)}; }
+    F4 operator * (const F4& o) const { return {_mm_mul_ps(v, o.v)}; }
+    F4 operator & (const F4& o) const { return {_mm_and_ps(v, o.v)}; }
+    F4 operator | (const F4& o) const { return {_mm_or_ps(v, o.v)}; }
+
+    F4 ge(const F4& o) const { return {_mm_cmpge_ps(v, o.v)}; }
+    F4 gt(const F4& o) const { return {_mm_cmpgt_ps(v, o.v)}; }
+
+    u32 mask() const { return _mm_movemask_ps(v); }
+
+    void store(float* out) const { _mm_storeu_ps(out, v); }
+#else
+    float v[4];
+
+    static F4 set(const float a)                                     { return {{a, a, a, a}}; }
+    static F4 set(const float a, const float b, const float c, const float d) { return {{a, b, c, d}}; }
+
+    template<typename Op>
+    F4 map(const F4& o, Op op) const
+    {
+        F4 r;
+        for(int i = 0; i < 4; i++){
+            r.v[i] = op(v[i], o.v[i]);
+        }
+        return r;
+    }
+
+    static float bits(const bool b)
+    {
+        const u32 all {b ? ~0u : 0u};
+        float f;
+        memcpy(&f, &all, sizeof(f));
+        return f;
+    }
+
+    static u32 raw(const float f)
+    {
+        u32 u;
+        memcpy(&u, &f, sizeof(u));
+        return u;
+    }
+
+    F4 operator + (const F4& o) const { return map(o, [](float a, float b){ return a + b; }); }
+    F4 operator * (const F4& o) const { return map(o, [](float a, float b){ return a * b; }); }
+    F4 operator & (const F4& o) const { return map(o, [](float a, float b){ return bits(raw(a) & raw(b)); }); }
+    F4 operator | (const F4& o) const { return map(o, [](float a, float b){ return bits(raw(a) | raw(b)); }); }
+
+    F4 ge(const F4& o) const { return map(o, [](float a, float b){ return bits(a >= b); }); }
+    F4 gt(const F4& o) const { return map(o, [](float a, float b){ return bits(a > b); }); }
+
+    u32 mask() const
+    {
+        u32 m {0};
+        for(int i = 0; i < 4; i++){
+            m |= (raw(v[i]) >> 31) << i;
+        }
+        return m;
+    }
+
+    void store(float* out) const { memcpy(out, v, sizeof(v)); }
+#endif
+};
+
+// cpu backend for the draw queue: same push constant layout, alpha and additive
+// blending, per vertex colors and the optional painter depth, into an rgba8 buffer
+//
+// triangles are set up and binned into screen tiles on the calling thread, tiles are
+// then handed out to workers one at a time so no two threads ever touch the same pixels.
+// coverage and barycentrics are evaluated four pixels at a time, top left fill rule
+//
+// pixels are stored srgb encoded and blended in linear space, like the swapchain
+struct SoftwareRasterizer
+{
+    enum Blend : u8
+    {
+        alpha,    // src alpha, one minus src alpha; the default pipeline
+        additive, // src alpha, one; alpha untouched, no depth write
+    };
+
+    struct Setup
+    {
+        // edge functions w = a * x + b * y + c, positive inside
+        float a[3];
+        float b[3];
+        float c[3];
+        bool top_left[3];
+        float inv_area;
+        RGBA colors[3];
+        float z[3];
+        int min_x;
+        int min_y;
+        int max_x;
+        int max_y;
+        Blend blend;
+    };
+
+    struct Stats
+    {
+        u32 triangles {0};
+        u64 fragments {0};
+    };
+
+    u32 width {0};
+    u32 height {0};
+    u32 tile_size {64};
+    u32 tiles_x {0};
+    u32 tiles_y {0};
+
+    bool depth_enabled {false};
+
+    Array<u32> pixels; // r g b a bytes
+    Array<float> depth;
+
+    Array<Blend> pipeline_blend;
+
+    Array<Setup> setups;
+    Array<Array<u32>> bins;
+
+    u32 clear_value {0};
+    bool clear_pending {false};
+
+    Stats stats;
+
+    float srgb_to_linear[256];
+    u8 linear_to_srgb[4096];
+
+    Array<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    u64 generation {0};
+    u32 busy {0};
+    bool quit {false};
+    std::atomic<u32> next_tile {0};
+    std::atomic<u64> fragments {0};
+
+    ~SoftwareRasterizer()
+    {
+        stop_workers();
+    }
+
+    void init(const u32 w, const u32 h, const u32 threads, const u32 tile = 64)
+    {
+        width = w;
+        height = h;
+        tile_size = tile;
+        tiles_x = (w + tile - 1) / tile;
+        tiles_y = (h + tile - 1) / tile;
+
+        pixels.assign(w * h, 0);
+        depth.assign(w * h, 1.f);
+        bins.resize(tiles_x * tiles_y);
+
+        for(u32 i = 0; i < 256; i++)
+        {
+            const auto c {i / 255.f};
+            srgb_to_linear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for(u32 i = 0; i < 4096; i++)
+        {
+            const auto l {i / 4095.f};
+            const auto c {l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.f / 2.4f) - 0.055f};
+            linear_to_srgb[i] = (u8)(c * 255.f + 0.5f);
+        }
+
+        set_threads(threads);
+    }
+
+    // the calling thread always works too, threads - 1 workers are started
+    void set_threads(const u32 threads)
+    {
+        stop_workers();
+
+        // a new worker must not take the last finished frame for a pending one
+        u64 current;
+        {
+            std::lock_guard lock {mutex};
+            quit = false;
+            current = generation;
+        }
+        for(u32 i = 1; i < threads; i++){
+            workers.emplace_back([this, current]{ worker(current); });
+        }
+    }
+
+    u32 thread_count() const
+    {
+        return workers.size() + 1;
+    }
+
+    void stop_workers()
+    {
+        {
+            std::lock_guard lock {mutex};
+            quit = true;
+        }
+        wake.notify_all();
+        for(auto& w : workers){
+            w.join();
+        }
+        workers.clear();
+    }
+
+    void clear(const RGBA& color)
+    {
+        clear_value = encode(color);
+        clear_pending = true;
+    }
+
+    // consumes the queue like DrawQueue::flush, in the same sorted order
+    void draw(DrawQueue& queue)
+    {
+        queue.build_keys();
+        queue.sort();
+
+        for(auto& i : queue.items)
+        {
+            const auto& d {queue.draws[i.index]};
+            const auto blend {d.pipeline < pipeline_blend.size() ? pipeline_blend[d.pipeline] : alpha};
+            const auto scissor {queue.scissor(d.clip, {width, height})};
+            for(u32 v = 0; v + 3 <= d.vertex_count; v += 3){
+                setup(d.data, blend, scissor);
+            }
+        }
+
+        queue.draws.clear();
+        queue.items.clear();
+        queue.reset_clips();
+    }
+
+    void setup(const float* data, const Blend blend, const VkRect2D& scissor)
+    {
+        // push constant layout: three xyzw positions in ndc, then three colors
+        float x[3];
+        float y[3];
+        float z[3];
+        RGBA colors[3];
+        for(int i = 0; i < 3; i++)
+        {
+            // snap to 1/256 of a pixel like the hardware does
+            x[i] = roundf((data[i * 4 + 0] + 1.f) * 0.5f * width * 256.f) / 256.f;
+            y[i] = roundf((data[i * 4 + 1] + 1.f) * 0.5f * height * 256.f) / 256.f;
+            z[i] = data[i * 4 + 2];
+            colors[i] = {data[12 + i * 4], data[13 + i * 4], data[14 + i * 4], data[15 + i * 4]};
+        }
+
+        auto area {(x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0])};
+        if(area == 0.f){
+            return;
+        }
+
+        // no culling, flip clockwise triangles so the edge functions are positive inside
+        if(area < 0.f)
+        {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(z[1], z[2]);
+            std::swap(colors[1], colors[2]);
+            area = -area;
+        }
+
+        Setup s;
+        s.min_x = std::max(scissor.offset.x, (int)floorf(std::min({x[0], x[1], x[2]})));
+        s.min_y = std::max(scissor.offset.y, (int)floorf(std::min({y[0], y[1], y[2]})));
+        s.max_x = std::min(scissor.offset.x + (int)scissor.extent.width - 1, (int)ceilf(std::max({x[0], x[1], x[2]})));
+        s.max_y = std::min(scissor.offset.y + (int)scissor.extent.height - 1, (int)ceilf(std::max({y[0], y[1], y[2]})));
+        if(s.min_x > s.max_x || s.min_y > s.max_y){
+            return;
+        }
+
+        for(int e = 0; e < 3; e++)
+        {
+            // edge e is opposite vertex e. shared edges are always evaluated from the same
+            // endpoint order so neighbours get exactly negated values and no pixel is hit twice
+            auto i0 {(e + 1) % 3};
+            auto i1 {(e + 2) % 3};
+            auto sign {1.f};
+            if(x[i1] < x[i0] || (x[i1] == x[i0] && y[i1] < y[i0]))
+            {
+                std::swap(i0, i1);
+                sign = -1.f;
+            }
+
+            const auto a {-(y[i1] - y[i0])};
+            const auto b {x[i1] - x[i0]};
+            s.a[e] = sign * a;
+            s.b[e] = sign * b;
+            s.c[e] = sign * -(a * x[i0] + b * y[i0]);
+
+            // y points down, the normal points into the triangle
+            s.top_left[e] = s.a[e] > 0.f || (s.a[e] == 0.f && s.b[e] > 0.f);
+        }
+
+        s.inv_area = 1.f / area;
+        for(int i = 0; i < 3; i++)
+        {
+            s.colors[i] = colors[i];
+            s.z[i] = z[i];
+        }
+        s.blend = blend;
+
+        const u32 index = setups.size();
+        setups.push_back(s);
+
+        const auto tx0 {s.min_x / tile_size};
+        const auto ty0 {s.min_y / tile_size};
+        const auto tx1 {s.max_x / tile_size};
+        const auto ty1 {s.max_y / tile_size};
+        for(u32 ty = ty0; ty <= ty1; ty++)
+        {
+            for(u32 tx = tx0; tx <= tx1; tx++){
+                bins[ty * tiles_x + tx].push_back(index);
+            }
+        }
+    }
+
+    // rasterizes everything drawn since the last finish
+    void finish()
+    {
+        stats.triangles = setups.size();
+        fragments = 0;
+
+        {
+            std::lock_guard lock {mutex};
+            next_tile = 0;
+            busy = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+
+        work();
+
+        {
+            std::unique_lock lock {mutex};
+            finished.wait(lock, [this]{ return busy == 0; });
+        }
+
+        stats.fragments = fragments;
+        setups.clear();
+        for(auto& b : bins){
+            b.clear();
+        }
+        clear_pending = false;
+    }
+
+    void worker(u64 seen)
+    {
+        while(true)
+        {
+            {
+                std::unique_lock lock {mutex};
+                wake.wait(lock, [&]{ return quit || generation != seen; });
+                if(quit){
+                    return;
+                }
+                seen = generation;
+            }
+
+            work();
+
+            {
+                std::lock_guard lock {mutex};
+                busy--;
+            }
+            finished.notify_one();
+        }
+    }
+
+    void work()
+    {
+        const u32 count {tiles_x * tiles_y};
+        for(u32 t = next_tile++; t < count; t = next_tile++){
+            raster_tile(t);
+        }
+    }
+
+    void raster_tile(const u32 tile)
+    {
+        const int x0 = (tile % tiles_x) * tile_size;
+        const int y0 = (tile / tiles_x) * tile_size;
+        const int x1 = std::min(x0 + (int)tile_size, (int)width) - 1;
+        const int y1 = std::min(y0 + (int)tile_size, (int)height) - 1;
+
+        if(clear_pending)
+        {
+            for(int y = y0; y <= y1; y++)
+            {
+                std::fill(&pixels[y * width + x0], &pixels[y * width + x1] + 1, clear_value);
+                std::fill(&depth[y * width + x0], &depth[y * width + x1] + 1, 1.f);
+            }
+        }
+
+        u64 shaded {0};
+        const auto lanes {F4::set(0.5f, 1.5f, 2.5f, 3.5f)};
+        const auto zero {F4::set(0.f)};
+
+        for(auto index : bins[tile])
+        {
+            const auto& s {setups[index]};
+            const auto min_x {std::max(s.min_x, x0)};
+            const auto min_y {std::max(s.min_y, y0)};
+            const auto max_x {std::min(s.max_x, x1)};
+            const auto max_y {std::min(s.max_y, y1)};
+
+            F4 a[3];
+            F4 top_left[3];
+            for(int e = 0; e < 3; e++)
+            {
+                a[e] = F4::set(s.a[e]);
+                top_left[e] = F4::set(s.top_left[e] ? 1.f : 0.f).gt(zero);
+            }
+            const auto inv_area {F4::set(s.inv_area)};
+
+            for(int y = min_y; y <= max_y; y++)
+            {
+                const auto py {y + 0.5f};
+                for(int x = min_x; x <= max_x; x += 4)
+                {
+                    const auto px {F4::set((float)x) + lanes};
+
+                    F4 w[3];
+                    auto inside {F4::set(0.f).ge(zero)};
+                    for(int e = 0; e < 3; e++)
+                    {
+                        w[e] = a[e] * px + F4::set(s.b[e] * py + s.c[e]);
+                        // on the edge only counts for top and left edges
+                        inside = inside & (w[e].gt(zero) | (w[e].ge(zero) & top_left[e]));
+                    }
+
+                    auto covered {inside.mask()};
+                    if(x + 4 > max_x + 1){
+                        covered &= (1u << (max_x + 1 - x)) - 1;
+                    }
+                    if(!covered){
+                        continue;
+                    }
+
+                    const auto b0 {w[0] * inv_area};
+                    const auto b1 {w[1] * inv_area};
+                    const auto b2 {w[2] * inv_area};
+
+                    float channel[5][4];
+                    for(int c = 0; c < 4; c++)
+                    {
+                        const auto v {b0 * F4::set(s.colors[0].c[c]) + b1 * F4::set(s.colors[1].c[c]) + b2 * F4::set(s.colors[2].c[c])};
+                        v.store(channel[c]);
+                    }
+                    if(depth_enabled){
+                        (b0 * F4::set(s.z[0]) + b1 * F4::set(s.z[1]) + b2 * F4::set(s.z[2])).store(channel[4]);
+                    }
+
+                    for(int l = 0; l < 4; l++)
+                    {
+                        if(!(covered & (1u << l))){
+                            continue;
+                        }
+
+                        const auto i {y * width + x + l};
+                        if(depth_enabled)
+                        {
+                            const auto z {channel[4][l]};
+                            if(z > depth[i]){
+                                continue;
+                            }
+                            if(s.blend == alpha){
+                                depth[i] = z;
+                            }
+                        }
+
+                        pixels[i] = blend(pixels[i], {channel[0][l], channel[1][l], channel[2][l], channel[3][l]}, s.blend);
+                        shaded++;
+                    }
+                }
+            }
+        }
+
+        fragments += shaded;
+    }
+
+    static float saturate(const float v)
+    {
+        return v < 0.f ? 0.f : (v > 1.f ? 1.f : v);
+    }
+
+    u8 encode_channel(const float linear) const
+    {
+        return linear_to_srgb[(u32)(saturate(linear) * 4095.f + 0.5f)];
+    }
+
+    u32 encode(const RGBA& c) const
+    {
+        return encode_channel(c.r) | encode_channel(c.g) << 8 | encode_channel(c.b) << 16 | (u32)(saturate(c.a) * 255.f + 0.5f) << 24;
+    }
+
+    u32 blend(const u32 dst, RGBA src, const Blend mode) const
+    {
+        const auto sa {saturate(src.a)};
+        if(mode == alpha && sa == 1.f){
+            return encode(src);
+        }
+
+        const RGBA d {srgb_to_linear[dst & 0xff], srgb_to_linear[(dst >> 8) & 0xff], srgb_to_linear[(dst >> 16) & 0xff], (dst >> 24) / 255.f};
+
+        RGBA r;
+        if(mode == additive)
+        {
+            r = {saturate(src.r) * sa + d.r, saturate(src.g) * sa + d.g, saturate(src.b) * sa + d.b, d.a};
+        }
+        else
+        {
+            r = {saturate(src.r) * sa + d.r * (1.f - sa), saturate(src.g) * sa + d.g * (1.f - sa),
+                 saturate(src.b) * sa + d.b * (1.f - sa), sa + d.a * (1.f - sa)};
+        }
+        return encode(r);
+    }
+
+    bool save_ppm(const char* path) const
+    {
+        auto* f {fopen(path, "wb")};
+        if(!f){
+            return false;
+        }
+        fprintf(f, "P6\n%u %u\n255\n", width, height);
+        Array<u8> row(width * 3);
+        for(u32 y = 0; y < height; y++)
+        {
+            for(u32 x = 0; x < width; x++)
+            {
+                const auto p {pixels[y * width + x]};
+                row[x * 3 + 0] = p & 0xff;
+                row[x * 3 + 1] = (p >> 8) & 0xff;
+                row[x * 3 + 2] = (p >> 16) & 0xff;
+            }
+            fwrite(row.data(), 1, row.size(), f);
+        }
+        fclose(f);
+        return true;
+    }
+};
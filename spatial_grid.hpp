@@ -0,0 +1,221 @@
+#pragma once
+
+#include <unordered_map>
+#include <chrono>
+#include <cassert>
+#include <cmath>
+
+#include "types.hpp"
+
+inline bool overlaps(const Rect& a, const Rect& b)
+{
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+           a.min.y <= b.max.y && a.max.y >= b.min.y;
+}
+
+// uniform grid over world space, cells are only allocated once something lands
+// in them so the world can be arbitrarily large. shapes spanning several cells are
+// stored in each of them and deduplicated during queries with a stamp
+struct SpatialGrid
+{
+    struct Entry
+    {
+        Rect bounds;
+        int x0, y0, x1, y1; // covered cell range
+        u32 stamp {0};
+        bool alive {false};
+    };
+
+    struct Stats
+    {
+        u32 visible {0};
+        u32 culled {0};
+        u32 cells_visited {0};
+        float query_ms {0.f};
+    };
+
+    float cell_size {256.f};
+
+    std::unordered_map<u64, Array<u32>> cells;
+    Array<Entry> entries;
+    Array<u32> free_ids;
+
+    u32 stamp {0};
+    u32 alive_count {0};
+
+    Stats stats;
+
+    void init(const float size)
+    {
+        cell_size = size;
+    }
+
+    u64 key(const int x, const int y) const
+    {
+        return ((u64)(u32)x << 32) | (u32)y;
+    }
+
+    int cell(const float v) const
+    {
+        return (int)floorf(v / cell_size);
+    }
+
+    void link(const u32 id)
+    {
+        auto& e {entries[id]};
+        for(int y = e.y0; y <= e.y1; y++)
+        {
+            for(int x = e.x0; x <= e.x1; x++){
+                cells[key(x, y)].push_back(id);
+            }
+        }
+    }
+
+    void unlink(const u32 id)
+    {
+        auto& e {entries[id]};
+        for(int y = e.y0; y <= e.y1; y++)
+        {
+            for(int x = e.x0; x <= e.x1; x++)
+            {
+                auto it {cells.find(key(x, y))};
+                if(it == cells.end()){
+                    continue;
+                }
+                auto& ids {it->second};
+                for(u32 i = 0; i < ids.size(); i++)
+                {
+                    if(ids[i] == id)
+                    {
+                        ids[i] = ids.back();
+                        ids.pop_back();
+                        break;
+                    }
+                }
+                if(ids.empty()){
+                    cells.erase(it);
+                }
+            }
+        }
+    }
+
+    u32 insert(const Rect& bounds)
+    {
+        u32 id;
+        if(free_ids.empty())
+        {
+            id = entries.size();
+            entries.push_back({});
+        }
+        else
+        {
+            id = free_ids.back();
+            free_ids.pop_back();
+        }
+
+        auto& e {entries[id]};
+        e.bounds = bounds;
+        e.x0 = cell(bounds.min.x);
+        e.y0 = cell(bounds.min.y);
+        e.x1 = cell(bounds.max.x);
+        e.y1 = cell(bounds.max.y);
+        e.stamp = stamp;
+        e.alive = true;
+        link(id);
+        alive_count++;
+        return id;
+    }
+
+    // only touches the cell lists when the covered cell range actually changes,
+    // small moves inside a cell are just a bounds update
+    void move(const u32 id, const Rect& bounds)
+    {
+        auto& e {entries[id]};
+        assert(e.alive);
+        e.bounds = bounds;
+
+        const auto x0 {cell(bounds.min.x)};
+        const auto y0 {cell(bounds.min.y)};
+        const auto x1 {cell(bounds.max.x)};
+        const auto y1 {cell(bounds.max.y)};
+
+        if(x0 == e.x0 && y0 == e.y0 && x1 == e.x1 && y1 == e.y1){
+            return;
+        }
+
+        unlink(id);
+        e.x0 = x0;
+        e.y0 = y0;
+        e.x1 = x1;
+        e.y1 = y1;
+        link(id);
+    }
+
+    void remove(const u32 id)
+    {
+        auto& e {entries[id]};
+        assert(e.alive);
+        unlink(id);
+        e.alive = false;
+        free_ids.push_back(id);
+        alive_count--;
+    }
+
+    void query(const Rect& view, Array<u32>& out)
+    {
+        using Clock = std::chrono::high_resolution_clock;
+        const auto start {Clock::now()};
+
+        out.clear();
+        stamp++;
+        stats.cells_visited = 0;
+
+        const auto x0 {cell(view.min.x)};
+        const auto y0 {cell(view.min.y)};
+        const auto x1 {cell(view.max.x)};
+        const auto y1 {cell(view.max.y)};
+
+        // a view covering more cells than exist walks the occupied cells instead
+        const auto range {(u64)(x1 - x0 + 1) * (u64)(y1 - y0 + 1)};
+
+        auto visit {[&](const Array<u32>& ids)
+        {
+            stats.cells_visited++;
+            for(auto id : ids)
+            {
+                auto& e {entries[id]};
+                if(e.stamp == stamp){
+                    continue;
+                }
+                e.stamp = stamp;
+                if(overlaps(e.bounds, view)){
+                    out.push_back(id);
+                }
+            }
+        }};
+
+        if(range > cells.size())
+        {
+            for(auto& [k, ids] : cells){
+                visit(ids);
+            }
+        }
+        else
+        {
+            for(int y = y0; y <= y1; y++)
+            {
+                for(int x = x0; x <= x1; x++)
+                {
+                    auto it {cells.find(key(x, y))};
+                    if(it != cells.end()){
+                        visit(it->second);
+                    }
+                }
+            }
+        }
+
+        stats.visible = out.size();
+        stats.culled = alive_count - stats.visible;
+        stats.query_ms = std::chrono::duration<float, std::milli>{Clock::now() - start}.count();
+    }
+};
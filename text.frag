@@ -0,0 +1,16 @@
+#version 450
+
+layout(set = 0, binding = 1) uniform sampler2D atlas;
+
+layout(location = 0) in vec2 uv;
+layout(location = 1) in vec4 color;
+
+layout(location = 0) out vec4 frag;
+
+void main()
+{
+    // 0.5 is the glyph edge, fwidth keeps it about a pixel wide at any size
+    float d = texture(atlas, uv).r;
+    float w = max(fwidth(d), 1e-4);
+    frag = vec4(color.rgb, color.a * smoothstep(0.5 - w, 0.5 + w, d));
+}
@@ -0,0 +1,463 @@
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include "context.hpp"
+#include "font.hpp"
+#include "utilities.hpp"
+
+// one instanced quad per glyph, rect in ndc and uv as min/max pairs
+struct TextGlyph
+{
+    V4 rect;
+    V4 uv;
+    RGBA color;
+};
+
+// labels drawn from a signed distance field atlas in one instanced draw
+//
+// glyphs are turned into distance fields the first time they are used and copied into
+// the atlas before the render pass starts. laid out strings are cached by text and size,
+// so a label that didn't change since the last frame costs a hash lookup and a copy of
+// its quads. layouts that go unused for a while are dropped
+struct TextRenderer
+{
+    static constexpr u32 atlas_size {512};
+    static constexpr u32 texels_per_unit {4}; // one unit is one pixel of the 5x7 font
+    static constexpr u32 spread {4};          // texels of distance on each side of the glyph
+    static constexpr u32 cell_width {font_columns * texels_per_unit + spread * 2};
+    static constexpr u32 cell_height {font_rows * texels_per_unit + spread * 2};
+    static constexpr u32 cells_per_row {atlas_size / cell_width};
+    static constexpr u32 glyph_count {font_last - font_first + 1};
+
+    static constexpr float advance {font_columns + 1.f}; // in font units
+    static constexpr float line_height {font_rows + 3.f};
+
+    static constexpr u64 evict_after {120}; // frames
+
+    // quad relative to the string origin in font units, scaled on use
+    struct Quad
+    {
+        V4 rect;
+        V4 uv;
+    };
+
+    struct Layout
+    {
+        Array<Quad> quads;
+        V2 size;
+        u64 last_used;
+    };
+
+    struct Stats
+    {
+        u32 labels {0};
+        u32 glyphs {0};
+        u32 dropped {0};
+        u32 layout_hits {0};
+        u32 layout_misses {0};
+        u32 rasterized {0}; // glyphs in the atlas
+        u32 cached {0};     // layouts in the cache
+    };
+
+    Context* context {nullptr};
+
+    Image atlas;
+    Buffer staging; // the whole atlas, host side
+    Buffer glyphs;
+    u32 capacity {0};
+    u32 count {0};
+
+    VkSampler sampler;
+    VkDescriptorSetLayout set_layout;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet set;
+    u32 pipeline;
+
+    bool ready[glyph_count] {};
+    Array<u32> dirty;
+    bool atlas_initialized {false};
+
+    std::unordered_map<String, Layout> layouts;
+    String key;
+    u64 frame {0};
+
+    Stats stats;
+
+    void init(Context& c, const u32 max_glyphs = 1 << 16)
+    {
+        VkResult err;
+
+        context = &c;
+        capacity = max_glyphs;
+
+        atlas = c.create_image({atlas_size, atlas_size}, VK_FORMAT_R8_UNORM,
+                               VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        staging = c.create_buffer(atlas_size * atlas_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        memset(staging.data, 0, atlas_size * atlas_size);
+
+        glyphs = c.create_buffer(sizeof(TextGlyph) * capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        {
+            VkSamplerCreateInfo info
+            {
+                .sType = VKT(SAMPLER_CREATE_INFO),
+                .magFilter = VK_FILTER_LINEAR,
+                .minFilter = VK_FILTER_LINEAR,
+                .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                .maxLod = 0.f,
+            };
+            err = vkCreateSampler(c.gpu->device, &info, nullptr, &sampler);
+            check_vk(err);
+        }
+
+        {
+            VkDescriptorSetLayoutBinding bindings[2] {};
+            bindings[0].binding = 0;
+            bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[0].descriptorCount = 1;
+            bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+            bindings[1].binding = 1;
+            bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            bindings[1].descriptorCount = 1;
+            bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+            VkDescriptorSetLayoutCreateInfo info
+            {
+                .sType = VKT(DESCRIPTOR_SET_LAYOUT_CREATE_INFO),
+                .bindingCount = array_size(bindings),
+                .pBindings = bindings,
+            };
+            err = vkCreateDescriptorSetLayout(c.gpu->device, &info, nullptr, &set_layout);
+            check_vk(err);
+        }
+
+        {
+            VkDescriptorPoolSize sizes[2]
+            {
+                {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1},
+                {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1},
+            };
+
+            VkDescriptorPoolCreateInfo info
+            {
+                .sType = VKT(DESCRIPTOR_POOL_CREATE_INFO),
+                .maxSets = 1,
+                .poolSizeCount = array_size(sizes),
+                .pPoolSizes = sizes,
+            };
+            err = vkCreateDescriptorPool(c.gpu->device, &info, nullptr, &descriptor_pool);
+            check_vk(err);
+
+            VkDescriptorSetAllocateInfo allocate_info
+            {
+                .sType = VKT(DESCRIPTOR_SET_ALLOCATE_INFO),
+                .descriptorPool = descriptor_pool,
+                .descriptorSetCount = 1,
+                .pSetLayouts = &set_layout,
+            };
+            err = vkAllocateDescriptorSets(c.gpu->device, &allocate_info, &set);
+            check_vk(err);
+        }
+
+        {
+            VkDescriptorBufferInfo buffer {.buffer = glyphs.buffer, .offset = 0, .range = VK_WHOLE_SIZE};
+            VkDescriptorImageInfo image
+            {
+                .sampler = sampler,
+                .imageView = atlas.view,
+                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            };
+
+            VkWriteDescriptorSet writes[2] {};
+            for(u32 i = 0; i < array_size(writes); i++)
+            {
+                writes[i].sType = VKT(WRITE_DESCRIPTOR_SET);
+                writes[i].dstSet = set;
+                writes[i].dstBinding = i;
+                writes[i].descriptorCount = 1;
+            }
+            writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[0].pBufferInfo = &buffer;
+            writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            writes[1].pImageInfo = &image;
+            vkUpdateDescriptorSets(c.gpu->device, array_size(writes), writes, 0, nullptr);
+        }
+
+        pipeline = c.add_new_pipeline([&c, this]() -> Pipeline
+        {
+            Pipeline result;
+            VkResult err;
+            auto info {c.new_pipeline_create_info()};
+
+            // drawn over the scene, tested against it but never written
+            if(c.depth_enabled){
+                info.pDepthStencilState = &c.blend_depth_stencil_info;
+            }
+
+            auto vertex {c.load_shader("text.vert.spv")};
+            auto fragment {c.load_shader("text.frag.spv")};
+
+            const auto shader_count {2};
+
+            info.stageCount = shader_count;
+
+            VkPipelineShaderStageCreateInfo shader_stages[shader_count] {};
+
+            shader_stages[0] = c.new_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vertex);
+            shader_stages[1] = c.new_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, fragment);
+            info.pStages = shader_stages;
+
+            VkPipelineLayoutCreateInfo layout_info
+            {
+                .sType = VKT(PIPELINE_LAYOUT_CREATE_INFO),
+                .setLayoutCount = 1,
+                .pSetLayouts = &set_layout,
+            };
+
+            err = vkCreatePipelineLayout(c.gpu->device, &layout_info, nullptr, &result.layout);
+            check_vk(err);
+
+            info.layout = result.layout;
+            err = vkCreateGraphicsPipelines(c.gpu->device, VK_NULL_HANDLE, 1, &info, nullptr, &result.pipeline);
+            check_vk(err);
+            vkDestroyShaderModule(c.gpu->device, vertex, nullptr);
+            vkDestroyShaderModule(c.gpu->device, fragment, nullptr);
+            return result;
+        });
+    }
+
+    // after Context::begin_frame, the fence there means the glyph buffer is free again
+    void begin_frame()
+    {
+        frame++;
+        count = 0;
+
+        const auto rasterized {stats.rasterized};
+        stats = {};
+        stats.rasterized = rasterized;
+
+        if(frame % evict_after == 0)
+        {
+            for(auto it = layouts.begin(); it != layouts.end();)
+            {
+                if(frame - it->second.last_used > evict_after){
+                    it = layouts.erase(it);
+                }
+                else{
+                    ++it;
+                }
+            }
+        }
+    }
+
+    static u32 glyph_index(const char ch)
+    {
+        const auto c {(u8)ch};
+        return (c < font_first || c > font_last ? '?' : c) - font_first;
+    }
+
+    // exact distance to the union of the lit font pixels, in texels, positive inside
+    void rasterize(const u32 g)
+    {
+        const auto& rows {font_5x7[g]};
+        const auto cell_x {(g % cells_per_row) * cell_width};
+        const auto cell_y {(g / cells_per_row) * cell_height};
+        auto* texels {(u8*)staging.data};
+
+        auto lit {[&](const int x, const int y)
+        {
+            if(x < 0 || y < 0 || x >= (int)font_columns || y >= (int)font_rows){
+                return false;
+            }
+            return ((rows[y] >> (font_columns - 1 - x)) & 1) != 0;
+        }};
+
+        for(u32 ty = 0; ty < cell_height; ty++)
+        {
+            for(u32 tx = 0; tx < cell_width; tx++)
+            {
+                // texel center in font units
+                const auto px {((float)tx + 0.5f - spread) / texels_per_unit};
+                const auto py {((float)ty + 0.5f - spread) / texels_per_unit};
+                const auto inside {lit((int)floorf(px), (int)floorf(py))};
+
+                // nearest font pixel of the other kind, the box distance is exact for squares
+                auto nearest {1e9f};
+                for(int y = -1; y <= (int)font_rows; y++)
+                {
+                    for(int x = -1; x <= (int)font_columns; x++)
+                    {
+                        if(lit(x, y) == inside){
+                            continue;
+                        }
+                        const auto dx {fmaxf(fmaxf(x - px, px - (x + 1)), 0.f)};
+                        const auto dy {fmaxf(fmaxf(y - py, py - (y + 1)), 0.f)};
+                        nearest = fminf(nearest, dx * dx + dy * dy);
+                    }
+                }
+
+                const auto distance {sqrtf(nearest) * texels_per_unit * (inside ? 1.f : -1.f)};
+                const auto value {128.f + distance * (127.f / spread)};
+                texels[(cell_y + ty) * atlas_size + cell_x + tx] = (u8)fminf(fmaxf(value, 0.f), 255.f);
+            }
+        }
+
+        ready[g] = true;
+        dirty.push_back(g);
+        stats.rasterized++;
+    }
+
+    const Layout& layout(const String& text, const float size)
+    {
+        key.assign(text);
+        key.append((const char*)&size, sizeof(size));
+
+        auto it {layouts.find(key)};
+        if(it != layouts.end())
+        {
+            stats.layout_hits++;
+            it->second.last_used = frame;
+            return it->second;
+        }
+        stats.layout_misses++;
+
+        Layout result;
+        result.last_used = frame;
+        result.quads.reserve(text.size());
+
+        const auto pad {(float)spread / texels_per_unit};
+        float x {0.f};
+        float y {0.f};
+        float width {0.f};
+        for(auto ch : text)
+        {
+            if(ch == '\n')
+            {
+                width = fmaxf(width, x);
+                x = 0.f;
+                y += line_height;
+                continue;
+            }
+
+            const auto g {glyph_index(ch)};
+            if(ch != ' ')
+            {
+                if(!ready[g]){
+                    rasterize(g);
+                }
+
+                const auto u {(float)((g % cells_per_row) * cell_width) / atlas_size};
+                const auto v {(float)((g / cells_per_row) * cell_height) / atlas_size};
+                result.quads.push_back({{x - pad, y - pad, x + font_columns + pad, y + font_rows + pad},
+                                        {u, v, u + (float)cell_width / atlas_size, v + (float)cell_height / atlas_size}});
+            }
+            x += advance;
+        }
+        result.size = {fmaxf(width, x) * size / font_rows, (y + font_rows) * size / font_rows};
+
+        return layouts.emplace(key, std::move(result)).first->second;
+    }
+
+    // size is the cap height in pixels, position the top left of the first line
+    V2 add(const String& text, const V2 position, const float size, const RGBA& color)
+    {
+        auto& c {*context};
+        const auto& l {layout(text, size)};
+        const auto scale {size / font_rows};
+
+        stats.labels++;
+
+        auto* out {(TextGlyph*)glyphs.data};
+        for(auto& q : l.quads)
+        {
+            if(count == capacity)
+            {
+                stats.dropped++;
+                continue;
+            }
+
+            const auto lo {c.norm(position.x + q.rect.x * scale, position.y + q.rect.y * scale)};
+            const auto hi {c.norm(position.x + q.rect.z * scale, position.y + q.rect.w * scale)};
+            out[count++] = {{lo.x, lo.y, hi.x, hi.y}, q.uv, color};
+            stats.glyphs++;
+        }
+        return l.size;
+    }
+
+    // copies glyphs rasterized this frame into the atlas, has to be recorded between
+    // Context::begin_frame and Context::begin_render_pass
+    void upload(VkCommandBuffer cmd)
+    {
+        stats.cached = layouts.size();
+
+        if(dirty.empty() && atlas_initialized){
+            return;
+        }
+
+        VkImageMemoryBarrier barrier
+        {
+            .sType = VKT(IMAGE_MEMORY_BARRIER),
+            .srcAccessMask = atlas_initialized ? VK_ACCESS_SHADER_READ_BIT : 0u,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .oldLayout = atlas_initialized ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = atlas.image,
+            .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1},
+        };
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+
+        Array<VkBufferImageCopy> regions;
+        if(!atlas_initialized)
+        {
+            // the first copy takes everything, untouched cells included
+            regions.push_back({.bufferOffset = 0, .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                               .imageExtent = {atlas_size, atlas_size, 1}});
+        }
+        else
+        {
+            for(auto g : dirty)
+            {
+                const auto x {(g % cells_per_row) * cell_width};
+                const auto y {(g / cells_per_row) * cell_height};
+                regions.push_back({.bufferOffset = (VkDeviceSize)y * atlas_size + x, .bufferRowLength = atlas_size,
+                                   .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                                   .imageOffset = {(int)x, (int)y, 0}, .imageExtent = {cell_width, cell_height, 1}});
+            }
+        }
+        vkCmdCopyBufferToImage(cmd, staging.buffer, atlas.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regions.size(), regions.data());
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+
+        dirty.clear();
+        atlas_initialized = true;
+    }
+
+    void draw(VkCommandBuffer cmd)
+    {
+        if(!count){
+            return;
+        }
+
+        const auto& pl {context->get_pipeline(pipeline)};
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pl.pipeline);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pl.layout, 0, 1, &set, 0, nullptr);
+        vkCmdDraw(cmd, 6, count, 0, 0);
+    }
+};
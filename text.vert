@@ -0,0 +1,24 @@
+#version 450
+
+struct Glyph
+{
+    vec4 rect;
+    vec4 uv;
+    vec4 color;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Glyphs { Glyph glyphs[]; };
+
+layout(location = 0) out vec2 uv;
+layout(location = 1) out vec4 color;
+
+const vec2 corners[6] = vec2[](vec2(0, 0), vec2(1, 0), vec2(0, 1), vec2(1, 0), vec2(1, 1), vec2(0, 1));
+
+void main()
+{
+    Glyph g = glyphs[gl_InstanceIndex];
+    vec2 c = corners[gl_VertexIndex];
+    gl_Position = vec4(mix(g.rect.xy, g.rect.zw, c), 0, 1);
+    uv = mix(g.uv.xy, g.uv.zw, c);
+    color = g.color;
+}
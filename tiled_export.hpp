@@ -0,0 +1,337 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+
+#include "context.hpp"
+
+// renders images far larger than the swapchain, one extent sized tile at a time, and
+// streams every finished tile straight into a binary ppm on disk
+//
+// tiles are rendered with the regular pipelines: the export render pass only differs from
+// the main one in layouts, which keeps the two compatible, and the tiles have the same
+// extent so the baked viewport fits. the caller moves the scene under the tile by setting
+// Context::view
+//
+// a few slots are in flight, each with its own image, readback buffer and fence, so the
+// gpu renders tile n while the cpu writes tile n - slots. memory stays at slots tiles
+// whatever the size of the export
+struct TiledExport
+{
+    struct Slot
+    {
+        Image color;
+        Image depth;
+        VkFramebuffer framebuffer;
+        Buffer readback;
+        VkCommandBuffer command_buffer;
+        VkFence fence;
+        u32 tile;
+        bool busy {false};
+    };
+
+    struct Stats
+    {
+        u32 tiles {0};
+        float seconds {0.f};
+        u64 bytes {0};
+    };
+
+    Context* context {nullptr};
+    VkRenderPass render_pass {VK_NULL_HANDLE};
+    Array<Slot> slots;
+    Stats stats;
+
+    // output state for the current run
+    std::ofstream file;
+    std::streamoff header_size {0};
+    u32 width {0};
+    u32 height {0};
+    u32 tiles_x {0};
+    Array<u8> row;
+
+    void init(Context& c, const u32 slot_count = 3)
+    {
+        context = &c;
+        VkResult err;
+        const auto device {c.gpu->device};
+
+        {
+            VkAttachmentDescription attachments[]
+            {
+                {
+                    .format = c.gpu->format.format,
+                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                    .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                    .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                    .finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                },
+                {
+                    .format = c.depth_format,
+                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                    .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                    .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                    .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                },
+            };
+
+            VkAttachmentReference color_attachment {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+            VkAttachmentReference depth_attachment {1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+            VkSubpassDescription sp
+            {
+                .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+                .colorAttachmentCount = 1,
+                .pColorAttachments = &color_attachment,
+                .pDepthStencilAttachment = c.depth_enabled ? &depth_attachment : nullptr,
+            };
+
+            // the final layout transition has to finish before the copy out of the tile
+            VkSubpassDependency dependency
+            {
+                .srcSubpass = 0,
+                .dstSubpass = VK_SUBPASS_EXTERNAL,
+                .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT,
+                .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+            };
+
+            VkRenderPassCreateInfo info
+            {
+                .sType = VKT(RENDER_PASS_CREATE_INFO),
+                .attachmentCount = c.depth_enabled ? 2u : 1u,
+                .pAttachments = attachments,
+                .subpassCount = 1,
+                .pSubpasses = &sp,
+                .dependencyCount = 1,
+                .pDependencies = &dependency,
+            };
+
+            err = vkCreateRenderPass(device, &info, nullptr, &render_pass);
+            check_vk(err);
+        }
+
+        slots.resize(slot_count);
+        for(auto& s : slots)
+        {
+            s.color = c.create_image(c.extent, c.gpu->format.format,
+                                     VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+            if(c.depth_enabled){
+                s.depth = c.create_image(c.extent, c.depth_format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+            }
+
+            VkImageView attachments[] {s.color.view, c.depth_enabled ? s.depth.view : VK_NULL_HANDLE};
+            VkFramebufferCreateInfo framebuffer_info
+            {
+                .sType = VKT(FRAMEBUFFER_CREATE_INFO),
+                .renderPass = render_pass,
+                .attachmentCount = c.depth_enabled ? 2u : 1u,
+                .pAttachments = attachments,
+                .width = c.extent.width,
+                .height = c.extent.height,
+                .layers = 1,
+            };
+            err = vkCreateFramebuffer(device, &framebuffer_info, nullptr, &s.framebuffer);
+            check_vk(err);
+
+            s.readback = c.create_buffer((VkDeviceSize)c.extent.width * c.extent.height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+            VkCommandBufferAllocateInfo buffer_info
+            {
+                .sType = VKT(COMMAND_BUFFER_ALLOCATE_INFO),
+                .commandPool = c.command_pool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+            };
+            err = vkAllocateCommandBuffers(device, &buffer_info, &s.command_buffer);
+            check_vk(err);
+
+            VkFenceCreateInfo fence_info {.sType = VKT(FENCE_CREATE_INFO)};
+            err = vkCreateFence(device, &fence_info, nullptr, &s.fence);
+            check_vk(err);
+        }
+    }
+
+    // draw records the scene for the tile into the command buffer, Context::view is
+    // already set to the part of the scene under the tile. the scene is scaled so its
+    // width matches the export's
+    template<typename F>
+    bool run(const char* path, const u32 w, const u32 h, const RGBA& clear, F draw)
+    {
+        auto& c {*context};
+        const auto start {std::chrono::high_resolution_clock::now()};
+
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if(!file){
+            return false;
+        }
+
+        width = w;
+        height = h;
+        stats = {};
+
+        const auto header {"P6\n" + std::to_string(w) + " " + std::to_string(h) + "\n255\n"};
+        file.write(header.data(), header.size());
+        header_size = header.size();
+
+        const auto tile_w {c.extent.width};
+        const auto tile_h {c.extent.height};
+        tiles_x = (w + tile_w - 1) / tile_w;
+        const auto tiles_y {(h + tile_h - 1) / tile_h};
+        row.resize(tile_w * 3);
+
+        const auto saved_view {c.view};
+        const auto scale {(float)w / c.width};
+
+        for(u32 t = 0; t < tiles_x * tiles_y; t++)
+        {
+            auto& s {slots[t % slots.size()]};
+            if(s.busy){
+                write_tile(s);
+            }
+
+            const auto x0 {(t % tiles_x) * tile_w};
+            const auto y0 {(t / tiles_x) * tile_h};
+            c.view = {{x0 / scale, y0 / scale}, {(x0 + tile_w) / scale, (y0 + tile_h) / scale}};
+
+            const auto cmd {s.command_buffer};
+            vkResetCommandBuffer(cmd, 0);
+
+            VkCommandBufferBeginInfo begin_info
+            {
+                .sType = VKT(COMMAND_BUFFER_BEGIN_INFO),
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            };
+            vkBeginCommandBuffer(cmd, &begin_info);
+
+            VkClearValue clear_values[2] {};
+            clear_values[0].color = {{clear.r, clear.g, clear.b, clear.a}};
+            clear_values[1].depthStencil = {1.f, 0};
+
+            VkRenderPassBeginInfo pass_info
+            {
+                .sType = VKT(RENDER_PASS_BEGIN_INFO),
+                .renderPass = render_pass,
+                .framebuffer = s.framebuffer,
+                .renderArea {.offset = {0, 0}, .extent = c.extent},
+                .clearValueCount = c.depth_enabled ? 2u : 1u,
+                .pClearValues = clear_values,
+            };
+            vkCmdBeginRenderPass(cmd, &pass_info, VK_SUBPASS_CONTENTS_INLINE);
+            vkCmdSetScissor(cmd, 0, 1, &c.scissor);
+            draw(cmd);
+            vkCmdEndRenderPass(cmd);
+
+            VkBufferImageCopy region
+            {
+                .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                .imageExtent = {tile_w, tile_h, 1},
+            };
+            vkCmdCopyImageToBuffer(cmd, s.color.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, s.readback.buffer, 1, &region);
+
+            VkBufferMemoryBarrier host_barrier
+            {
+                .sType = VKT(BUFFER_MEMORY_BARRIER),
+                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .buffer = s.readback.buffer,
+                .size = VK_WHOLE_SIZE,
+            };
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &host_barrier, 0, nullptr);
+
+            vkEndCommandBuffer(cmd);
+
+            VkSubmitInfo submit
+            {
+                .sType = VKT(SUBMIT_INFO),
+                .commandBufferCount = 1,
+                .pCommandBuffers = &cmd,
+            };
+            const auto err {vkQueueSubmit(c.gpu->device_queue, 1, &submit, s.fence)};
+            check_vk(err);
+
+            s.tile = t;
+            s.busy = true;
+        }
+
+        // drain in submission order
+        const u32 total {tiles_x * tiles_y};
+        for(u32 t = total > slots.size() ? total - slots.size() : 0; t < total; t++){
+            write_tile(slots[t % slots.size()]);
+        }
+
+        c.view = saved_view;
+        file.close();
+
+        stats.tiles = total;
+        stats.seconds = std::chrono::duration<float>{std::chrono::high_resolution_clock::now() - start}.count();
+        return true;
+    }
+
+    void write_tile(Slot& s)
+    {
+        auto& c {*context};
+        vkWaitForFences(c.gpu->device, 1, &s.fence, VK_TRUE, UINT64_MAX);
+        vkResetFences(c.gpu->device, 1, &s.fence);
+        s.busy = false;
+
+        const auto tile_w {c.extent.width};
+        const auto tile_h {c.extent.height};
+        const auto x0 {(s.tile % tiles_x) * tile_w};
+        const auto y0 {(s.tile / tiles_x) * tile_h};
+        const auto w {std::min(tile_w, width - x0)};
+        const auto h {std::min(tile_h, height - y0)};
+
+        const auto f {c.gpu->format.format};
+        const auto bgra {f == VK_FORMAT_B8G8R8A8_SRGB || f == VK_FORMAT_B8G8R8A8_UNORM};
+        const auto* pixels {(const u8*)s.readback.data};
+
+        for(u32 y = 0; y < h; y++)
+        {
+            const auto* src {pixels + (size_t)y * tile_w * 4};
+            for(u32 x = 0; x < w; x++)
+            {
+                row[x * 3 + 0] = src[x * 4 + (bgra ? 2 : 0)];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + (bgra ? 0 : 2)];
+            }
+
+            file.seekp(header_size + ((std::streamoff)(y0 + y) * width + x0) * 3);
+            file.write((const char*)row.data(), w * 3);
+            stats.bytes += w * 3;
+        }
+    }
+
+    void destroy()
+    {
+        auto& c {*context};
+        const auto device {c.gpu->device};
+        vkDeviceWaitIdle(device);
+
+        for(auto& s : slots)
+        {
+            vkDestroyFence(device, s.fence, nullptr);
+            vkFreeCommandBuffers(device, c.command_pool, 1, &s.command_buffer);
+            vkDestroyFramebuffer(device, s.framebuffer, nullptr);
+            c.destroy_buffer(s.readback);
+            c.destroy_image(s.color);
+            if(c.depth_enabled){
+                c.destroy_image(s.depth);
+            }
+        }
+        slots.clear();
+
+        vkDestroyRenderPass(device, render_pass, nullptr);
+        render_pass = VK_NULL_HANDLE;
+    }
+};
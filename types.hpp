@@ -18,6 +18,12 @@ struct V2
     float y {0};
 };
 
+struct Rect
+{
+    V2 min;
+    V2 max;
+};
+
 template<typename T, size_t R, size_t C>
 struct Matrix
 {
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <cassert>
+#include <cstddef>
+
+#define VKT(x) VK_STRUCTURE_TYPE_##x
+
+#define check_vk(x) if(x != VK_SUCCESS) assert(false);
+
 template<size_t S, typename T>
 constexpr size_t array_size(const T(&)[S]){
     return S;
 }
-
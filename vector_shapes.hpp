@@ -0,0 +1,636 @@
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include "context.hpp"
+#include "utilities.hpp"
+
+// a = center and radius (or half size) in ndc, b = kind specific, see vector_shapes.vert
+struct ShapeInstance
+{
+    V4 a;
+    V4 b;
+    RGBA color;
+};
+
+struct ShapeVertex
+{
+    V4 position;
+    RGBA color;
+};
+
+// circles, rings, arcs, rounded rectangles and stroked polylines
+//
+// curved shapes are instances of unit meshes built once at init for every level of
+// detail and kept in one storage buffer. the level is picked from the on screen radius,
+// so drawing more circles never tessellates or uploads anything but the instance data
+//
+// polylines are tessellated on the cpu, with miter, bevel or round joins, and the
+// result is cached by the content of the line
+//
+// shapes are drawn in the order they were submitted. consecutive shapes on the same
+// mesh, or consecutive polylines, share a draw, so submitting similar shapes together
+// is what keeps the draw count down
+struct VectorShapes
+{
+    enum Kind : u32
+    {
+        fan,     // discs and pie slices
+        strip,   // rings and thick arcs
+        rounded, // rounded rectangles
+        line,    // polyline triangles
+    };
+
+    enum Join : u8
+    {
+        miter,
+        bevel,
+        round,
+    };
+
+    static constexpr u32 levels {9}; // fan and strip: 4 << level segments, rounded: 1 << level per corner
+    static constexpr float tolerance {0.2f}; // pixels between the curve and its chords
+    static constexpr float miter_limit {4.f};
+    static constexpr u64 evict_after {120};
+
+    struct Mesh
+    {
+        u32 first;
+        u32 count;
+    };
+
+    struct PushData
+    {
+        u32 kind;
+        u32 mesh_first;
+    };
+
+    // consecutive shapes drawn together, first and count index the instances, or the
+    // vertices for lines
+    struct Run
+    {
+        u32 kind;
+        u32 level;
+        u32 first;
+        u32 count;
+    };
+
+    struct Polyline
+    {
+        Array<V2> triangles; // pixels
+        u64 last_used;
+    };
+
+    struct Stats
+    {
+        u32 instances {0};
+        u32 draws {0};
+        u32 line_vertices {0};
+        u32 line_hits {0};
+        u32 line_misses {0};
+        u32 dropped {0};
+    };
+
+    Context* context {nullptr};
+
+    Buffer meshes;
+    Buffer instances;
+    Buffer vertices;
+    u32 instance_capacity {0};
+    u32 vertex_capacity {0};
+    u32 vertex_count {0};
+
+    Mesh mesh_table[3][levels];
+
+    Array<ShapeInstance> shapes; // submission order, copied into the instance buffer at draw
+    Array<Run> runs;
+
+    std::unordered_map<u64, Polyline> polylines;
+    u64 frame {0};
+
+    VkDescriptorSetLayout set_layout;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet set;
+    u32 pipeline;
+
+    Stats stats;
+
+    static Array<V4> build_meshes(Mesh (&table)[3][levels])
+    {
+        Array<V4> out;
+        constexpr auto quarter {(float)M_PI * 0.5f};
+
+        // (t, r): t runs along the sweep, r from the inner to the outer radius
+        for(u32 l = 0; l < levels; l++)
+        {
+            const u32 n {4u << l};
+            table[fan][l].first = out.size();
+            for(u32 i = 0; i < n; i++)
+            {
+                const auto t0 {(float)i / n};
+                const auto t1 {(float)(i + 1) / n};
+                out.push_back({t0, 0.f, 0.f, 0.f});
+                out.push_back({t0, 1.f, 0.f, 0.f});
+                out.push_back({t1, 1.f, 0.f, 0.f});
+            }
+            table[fan][l].count = out.size() - table[fan][l].first;
+        }
+
+        for(u32 l = 0; l < levels; l++)
+        {
+            const u32 n {4u << l};
+            table[strip][l].first = out.size();
+            for(u32 i = 0; i < n; i++)
+            {
+                const auto t0 {(float)i / n};
+                const auto t1 {(float)(i + 1) / n};
+                out.push_back({t0, 0.f, 0.f, 0.f});
+                out.push_back({t0, 1.f, 0.f, 0.f});
+                out.push_back({t1, 1.f, 0.f, 0.f});
+                out.push_back({t0, 0.f, 0.f, 0.f});
+                out.push_back({t1, 1.f, 0.f, 0.f});
+                out.push_back({t1, 0.f, 0.f, 0.f});
+            }
+            table[strip][l].count = out.size() - table[strip][l].first;
+        }
+
+        // (sign x, sign y, angle, on arc): corner centers sit at sign * (half size - radius)
+        const V2 signs[4] {{1.f, 1.f}, {-1.f, 1.f}, {-1.f, -1.f}, {1.f, -1.f}};
+        for(u32 l = 0; l < levels; l++)
+        {
+            const u32 n {1u << l};
+            table[rounded][l].first = out.size();
+            for(u32 c = 0; c < 4; c++)
+            {
+                const auto s {signs[c]};
+                const auto base {c * quarter};
+                for(u32 i = 0; i < n; i++)
+                {
+                    out.push_back({s.x, s.y, 0.f, 0.f});
+                    out.push_back({s.x, s.y, base + quarter * i / n, 1.f});
+                    out.push_back({s.x, s.y, base + quarter * (i + 1) / n, 1.f});
+                }
+
+                // edge between this corner and the next
+                const auto e {signs[(c + 1) % 4]};
+                const auto end {base + quarter};
+                out.push_back({s.x, s.y, 0.f, 0.f});
+                out.push_back({s.x, s.y, end, 1.f});
+                out.push_back({e.x, e.y, end, 1.f});
+                out.push_back({s.x, s.y, 0.f, 0.f});
+                out.push_back({e.x, e.y, end, 1.f});
+                out.push_back({e.x, e.y, 0.f, 0.f});
+            }
+            out.push_back({signs[0].x, signs[0].y, 0.f, 0.f});
+            out.push_back({signs[1].x, signs[1].y, 0.f, 0.f});
+            out.push_back({signs[2].x, signs[2].y, 0.f, 0.f});
+            out.push_back({signs[0].x, signs[0].y, 0.f, 0.f});
+            out.push_back({signs[2].x, signs[2].y, 0.f, 0.f});
+            out.push_back({signs[3].x, signs[3].y, 0.f, 0.f});
+            table[rounded][l].count = out.size() - table[rounded][l].first;
+        }
+
+        return out;
+    }
+
+    void init(Context& c, const u32 max_instances = 1 << 17, const u32 max_vertices = 1 << 18)
+    {
+        VkResult err;
+
+        context = &c;
+        instance_capacity = max_instances;
+        vertex_capacity = max_vertices;
+
+        const auto unit {build_meshes(mesh_table)};
+        meshes = c.create_buffer(sizeof(V4) * unit.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        memcpy(meshes.data, unit.data(), sizeof(V4) * unit.size());
+
+        instances = c.create_buffer(sizeof(ShapeInstance) * instance_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        vertices = c.create_buffer(sizeof(ShapeVertex) * vertex_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        {
+            VkDescriptorSetLayoutBinding bindings[3] {};
+            for(u32 i = 0; i < array_size(bindings); i++)
+            {
+                bindings[i].binding = i;
+                bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                bindings[i].descriptorCount = 1;
+                bindings[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+            }
+
+            VkDescriptorSetLayoutCreateInfo info
+            {
+                .sType = VKT(DESCRIPTOR_SET_LAYOUT_CREATE_INFO),
+                .bindingCount = array_size(bindings),
+                .pBindings = bindings,
+            };
+            err = vkCreateDescriptorSetLayout(c.gpu->device, &info, nullptr, &set_layout);
+            check_vk(err);
+        }
+
+        {
+            VkDescriptorPoolSize size
+            {
+                .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 3,
+            };
+
+            VkDescriptorPoolCreateInfo info
+            {
+                .sType = VKT(DESCRIPTOR_POOL_CREATE_INFO),
+                .maxSets = 1,
+                .poolSizeCount = 1,
+                .pPoolSizes = &size,
+            };
+            err = vkCreateDescriptorPool(c.gpu->device, &info, nullptr, &descriptor_pool);
+            check_vk(err);
+
+            VkDescriptorSetAllocateInfo allocate_info
+            {
+                .sType = VKT(DESCRIPTOR_SET_ALLOCATE_INFO),
+                .descriptorPool = descriptor_pool,
+                .descriptorSetCount = 1,
+                .pSetLayouts = &set_layout,
+            };
+            err = vkAllocateDescriptorSets(c.gpu->device, &allocate_info, &set);
+            check_vk(err);
+        }
+
+        {
+            VkDescriptorBufferInfo buffers[3]
+            {
+                {.buffer = meshes.buffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                {.buffer = instances.buffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                {.buffer = vertices.buffer, .offset = 0, .range = VK_WHOLE_SIZE},
+            };
+
+            VkWriteDescriptorSet writes[3] {};
+            for(u32 i = 0; i < array_size(writes); i++)
+            {
+                writes[i].sType = VKT(WRITE_DESCRIPTOR_SET);
+                writes[i].dstSet = set;
+                writes[i].dstBinding = i;
+                writes[i].descriptorCount = 1;
+                writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                writes[i].pBufferInfo = &buffers[i];
+            }
+            vkUpdateDescriptorSets(c.gpu->device, array_size(writes), writes, 0, nullptr);
+        }
+
+        pipeline = c.add_new_pipeline([&c, this]() -> Pipeline
+        {
+            Pipeline result;
+            VkResult err;
+            auto info {c.new_pipeline_create_info()};
+
+            if(c.depth_enabled){
+                info.pDepthStencilState = &c.blend_depth_stencil_info;
+            }
+
+            auto vertex {c.load_shader("vector_shapes.vert.spv")};
+
+            const auto shader_count {2};
+
+            info.stageCount = shader_count;
+
+            VkPipelineShaderStageCreateInfo shader_stages[shader_count] {};
+
+            shader_stages[0] = c.new_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vertex);
+            shader_stages[1] = c.new_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, c.use_generic_fragment());
+            info.pStages = shader_stages;
+
+            VkPushConstantRange constant
+            {
+                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+                .offset = 0,
+                .size = sizeof(PushData),
+            };
+
+            VkPipelineLayoutCreateInfo layout_info
+            {
+                .sType = VKT(PIPELINE_LAYOUT_CREATE_INFO),
+                .setLayoutCount = 1,
+                .pSetLayouts = &set_layout,
+                .pushConstantRangeCount = 1,
+                .pPushConstantRanges = &constant,
+            };
+
+            err = vkCreatePipelineLayout(c.gpu->device, &layout_info, nullptr, &result.layout);
+            check_vk(err);
+
+            info.layout = result.layout;
+            err = vkCreateGraphicsPipelines(c.gpu->device, VK_NULL_HANDLE, 1, &info, nullptr, &result.pipeline);
+            check_vk(err);
+            vkDestroyShaderModule(c.gpu->device, vertex, nullptr);
+            return result;
+        });
+    }
+
+    // after Context::begin_frame, the fence there means the buffers are free again
+    void begin_frame()
+    {
+        frame++;
+        stats = {};
+        vertex_count = 0;
+        shapes.clear();
+        runs.clear();
+
+        if(frame % evict_after == 0)
+        {
+            for(auto it = polylines.begin(); it != polylines.end();)
+            {
+                if(frame - it->second.last_used > evict_after){
+                    it = polylines.erase(it);
+                }
+                else{
+                    ++it;
+                }
+            }
+        }
+    }
+
+    // pixels of the render target per pixel of the scene, tiles of an export zoom in
+    float pixel_scale() const
+    {
+        const auto& c {*context};
+        return c.extent.width / (c.view.max.x - c.view.min.x);
+    }
+
+    // full circle segment count that keeps the chords within tolerance
+    static float segments_for(const float radius)
+    {
+        if(radius <= tolerance){
+            return 4.f;
+        }
+        return (float)M_PI / acosf(1.f - tolerance / radius);
+    }
+
+    static u32 level_for(const float segments, const u32 smallest)
+    {
+        u32 l {0};
+        while(l + 1 < levels && (float)(smallest << l) < segments){
+            l++;
+        }
+        return l;
+    }
+
+    void add(const Kind kind, const u32 level, const ShapeInstance& instance)
+    {
+        if(runs.empty() || runs.back().kind != kind || runs.back().level != level){
+            runs.push_back({kind, level, (u32)shapes.size(), 0});
+        }
+        runs.back().count++;
+        shapes.push_back(instance);
+    }
+
+    V4 ndc_radius(const float rx, const float ry) const
+    {
+        const auto& c {*context};
+        return {rx * 2.f / (c.view.max.x - c.view.min.x), ry * 2.f / (c.view.max.y - c.view.min.y), 0.f, 0.f};
+    }
+
+    // inner is a fraction of the radius, angles in radians clockwise from +x (y is down)
+    void arc(const V2 center, const float radius, const float inner, const float start, const float sweep, const RGBA& color)
+    {
+        const auto p {context->norm(center.x, center.y)};
+        const auto r {ndc_radius(radius, radius)};
+        const auto segments {segments_for(radius * pixel_scale()) * fminf(fabsf(sweep) / (2.f * (float)M_PI), 1.f)};
+
+        const auto kind {inner > 0.f ? strip : fan};
+        const auto level {level_for(segments, 4)};
+        add(kind, level, {{p.x, p.y, r.x, r.y}, {inner, start, sweep, 0.f}, color});
+    }
+
+    void circle(const V2 center, const float radius, const RGBA& color)
+    {
+        arc(center, radius, 0.f, 0.f, 2.f * (float)M_PI, color);
+    }
+
+    void ring(const V2 center, const float radius, const float thickness, const RGBA& color)
+    {
+        arc(center, radius, 1.f - thickness / radius, 0.f, 2.f * (float)M_PI, color);
+    }
+
+    void rounded_rectangle(const V2 position, const V2 size, float radius, const RGBA& color)
+    {
+        radius = fminf(radius, fminf(size.x, size.y) * 0.5f);
+        const auto p {context->norm(position.x + size.x * 0.5f, position.y + size.y * 0.5f)};
+        const auto half {ndc_radius(size.x * 0.5f, size.y * 0.5f)};
+        const auto r {ndc_radius(radius, radius)};
+        const auto level {level_for(segments_for(radius * pixel_scale()) * 0.25f, 1)};
+        add(rounded, level, {{p.x, p.y, half.x, half.y}, {r.x, r.y, 0.f, 0.f}, color});
+    }
+
+    static u64 hash(const void* data, const size_t size, u64 h = 14695981039346656037ull)
+    {
+        const auto* b {(const u8*)data};
+        for(size_t i = 0; i < size; i++)
+        {
+            h ^= b[i];
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    // thick line through the points, butt caps, closed lines join the last point to the first
+    static void tessellate(const V2* points, const u32 n, const float width, const Join join, const bool closed, Array<V2>& out)
+    {
+        out.clear();
+        if(n < 2){
+            return;
+        }
+
+        const auto hw {width * 0.5f};
+        const auto segments {closed ? n : n - 1};
+
+        auto direction {[&](const u32 i)
+        {
+            const auto a {points[i % n]};
+            const auto b {points[(i + 1) % n]};
+            auto dx {b.x - a.x};
+            auto dy {b.y - a.y};
+            const auto l {sqrtf(dx * dx + dy * dy)};
+            if(l > 0.f)
+            {
+                dx /= l;
+                dy /= l;
+            }
+            return V2 {dx, dy};
+        }};
+
+        auto triangle {[&](const V2 a, const V2 b, const V2 c)
+        {
+            out.push_back(a);
+            out.push_back(b);
+            out.push_back(c);
+        }};
+
+        for(u32 i = 0; i < segments; i++)
+        {
+            const auto a {points[i]};
+            const auto b {points[(i + 1) % n]};
+            const auto d {direction(i)};
+            const V2 nrm {-d.y * hw, d.x * hw};
+
+            const V2 a0 {a.x + nrm.x, a.y + nrm.y};
+            const V2 a1 {a.x - nrm.x, a.y - nrm.y};
+            const V2 b0 {b.x + nrm.x, b.y + nrm.y};
+            const V2 b1 {b.x - nrm.x, b.y - nrm.y};
+            triangle(a0, a1, b0);
+            triangle(a1, b1, b0);
+        }
+
+        // joins fill the wedge on the outside of each turn, the inside already overlaps
+        const auto first {closed ? 0u : 1u};
+        const auto last {closed ? n : n - 1};
+        for(u32 i = first; i < last; i++)
+        {
+            const auto p {points[i]};
+            const auto d0 {direction((i + n - 1) % n)};
+            const auto d1 {direction(i)};
+            const auto cross {d0.x * d1.y - d0.y * d1.x};
+            if(fabsf(cross) < 1e-6f){
+                continue;
+            }
+
+            // outer side is against the turn
+            const auto side {cross > 0.f ? -1.f : 1.f};
+            const V2 n0 {-d0.y * hw * side, d0.x * hw * side};
+            const V2 n1 {-d1.y * hw * side, d1.x * hw * side};
+            const V2 o0 {p.x + n0.x, p.y + n0.y};
+            const V2 o1 {p.x + n1.x, p.y + n1.y};
+
+            if(join == round)
+            {
+                auto a0 {atan2f(n0.y, n0.x)};
+                auto a1 {atan2f(n1.y, n1.x)};
+                auto sweep {a1 - a0};
+                if(sweep > (float)M_PI){
+                    sweep -= 2.f * (float)M_PI;
+                }
+                if(sweep < -(float)M_PI){
+                    sweep += 2.f * (float)M_PI;
+                }
+
+                const auto steps {std::max(1u, (u32)ceilf(segments_for(hw) * fabsf(sweep) / (2.f * (float)M_PI)))};
+                auto prev {o0};
+                for(u32 s = 1; s <= steps; s++)
+                {
+                    const auto a {a0 + sweep * s / steps};
+                    const V2 next {s == steps ? o1 : V2 {p.x + cosf(a) * hw, p.y + sinf(a) * hw}};
+                    triangle(p, prev, next);
+                    prev = next;
+                }
+                continue;
+            }
+
+            if(join == miter)
+            {
+                // miter point along the bisector, length hw / cos(half angle)
+                V2 m {n0.x + n1.x, n0.y + n1.y};
+                const auto ml {sqrtf(m.x * m.x + m.y * m.y)};
+                if(ml > 0.f)
+                {
+                    const auto cos_half {ml / (2.f * hw)};
+                    const auto length {hw / cos_half};
+                    if(length <= miter_limit * hw)
+                    {
+                        m = {p.x + m.x / ml * length, p.y + m.y / ml * length};
+                        triangle(p, o0, m);
+                        triangle(p, m, o1);
+                        continue;
+                    }
+                }
+            }
+
+            triangle(p, o0, o1);
+        }
+    }
+
+    void polyline(const V2* points, const u32 n, const float width, const RGBA& color, const Join join = miter, const bool closed = false)
+    {
+        // keyed by a hash of the content, a collision would draw another cached line
+        auto key {hash(points, sizeof(V2) * n)};
+        key = hash(&width, sizeof(width), key);
+        key = hash(&join, sizeof(join), key);
+        key = hash(&closed, sizeof(closed), key);
+
+        auto it {polylines.find(key)};
+        if(it == polylines.end())
+        {
+            stats.line_misses++;
+            Polyline p;
+            tessellate(points, n, width, join, closed, p.triangles);
+            it = polylines.emplace(key, std::move(p)).first;
+        }
+        else{
+            stats.line_hits++;
+        }
+        it->second.last_used = frame;
+
+        // the vertices of consecutive lines are contiguous, so they extend the same run
+        if(runs.empty() || runs.back().kind != line){
+            runs.push_back({line, 0, vertex_count, 0});
+        }
+        const auto first {vertex_count};
+
+        auto* out {(ShapeVertex*)vertices.data};
+        for(auto& v : it->second.triangles)
+        {
+            if(vertex_count == vertex_capacity)
+            {
+                stats.dropped++;
+                break;
+            }
+            const auto p {context->norm(v.x, v.y)};
+            out[vertex_count++] = {{p.x, p.y, 0.f, 1.f}, color};
+        }
+        runs.back().count += vertex_count - first;
+    }
+
+    void draw(VkCommandBuffer cmd)
+    {
+        const auto& pl {context->get_pipeline(pipeline)};
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pl.pipeline);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pl.layout, 0, 1, &set, 0, nullptr);
+
+        const u32 written = std::min<size_t>(shapes.size(), instance_capacity);
+        stats.dropped += shapes.size() - written;
+        memcpy(instances.data, shapes.data(), sizeof(ShapeInstance) * written);
+
+        for(auto& r : runs)
+        {
+            if(r.kind == line)
+            {
+                if(!r.count){
+                    continue;
+                }
+                const PushData data {line, 0};
+                vkCmdPushConstants(cmd, pl.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(data), &data);
+                vkCmdDraw(cmd, r.count, 1, r.first, 0);
+                stats.draws++;
+                continue;
+            }
+
+            // past the instance buffer, counted as dropped above
+            if(r.first >= written){
+                continue;
+            }
+            const auto n {std::min(r.count, written - r.first)};
+
+            const auto& mesh {mesh_table[r.kind][r.level]};
+            const PushData data {r.kind, mesh.first};
+            vkCmdPushConstants(cmd, pl.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(data), &data);
+            vkCmdDraw(cmd, mesh.count, n, 0, r.first);
+            stats.draws++;
+        }
+        stats.instances = written;
+        stats.line_vertices = vertex_count;
+    }
+};
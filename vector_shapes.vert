@@ -0,0 +1,62 @@
+#version 450
+
+struct Instance
+{
+    vec4 a;
+    vec4 b;
+    vec4 color;
+};
+
+struct Vertex
+{
+    vec4 position;
+    vec4 color;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Meshes { vec4 meshes[]; };
+layout(std430, set = 0, binding = 1) readonly buffer Instances { Instance instances[]; };
+layout(std430, set = 0, binding = 2) readonly buffer Vertices { Vertex vertices[]; };
+
+layout(push_constant) uniform Data
+{
+    uint kind;
+    uint mesh_first;
+};
+
+layout(location = 0) out vec4 color;
+
+const uint fan = 0;
+const uint strip = 1;
+const uint rounded = 2;
+const uint line = 3;
+
+void main()
+{
+    if(kind == line)
+    {
+        gl_Position = vertices[gl_VertexIndex].position;
+        color = vertices[gl_VertexIndex].color;
+        return;
+    }
+
+    Instance i = instances[gl_InstanceIndex];
+    vec4 v = meshes[mesh_first + gl_VertexIndex];
+    vec2 p;
+
+    if(kind == rounded)
+    {
+        // a.zw half size, b.xy corner radius
+        vec2 corner = v.xy * (i.a.zw - i.b.xy);
+        p = i.a.xy + corner + v.w * i.b.xy * vec2(cos(v.z), sin(v.z));
+    }
+    else
+    {
+        // a.zw radius, b.x inner radius fraction, b.y start angle, b.z sweep
+        float r = mix(i.b.x, 1.0, v.y);
+        float angle = i.b.y + v.x * i.b.z;
+        p = i.a.xy + i.a.zw * r * vec2(cos(angle), sin(angle));
+    }
+
+    gl_Position = vec4(p, 0, 1);
+    color = i.color;
+}